@@ -2,22 +2,52 @@
 #define NOB_STRIP_PREFIX
 #include "nob.h"
 
+#define EMULATOR_INPUTS "./src/apu.c", "./src/arena.c", "./src/audio.c", "./src/cpu.c", "./src/disassembler.c", "./src/emulator.c", "./src/fs.c", "./src/ines.c", "./src/mapper.c", "./src/ppu.c", "./src/rewind.c", "./src/tile.c"
+
 int main(int argc, char *argv[]) {
     NOB_GO_REBUILD_URSELF(argc, argv);
 
+    shift(argv, argc);
+
+    // Profiling builds count every executed opcode and instruction pointer and print them when the ROM stops
+    bool profile = false;
+
+    if (argc > 0 && strcmp(argv[0], "--profile") == 0) {
+        profile = true;
+        shift(argv, argc);
+    }
+
     Cmd cmd = {0};
 
     nob_cc(&cmd);
     nob_cc_flags(&cmd);
+    cmd_append(&cmd, "-O2");
+
+    if (profile) {
+        cmd_append(&cmd, "-DLOYD_PROFILE");
+    }
+
     nob_cc_output(&cmd, "loyd");
-    nob_cc_inputs(&cmd, "./src/main.c", "./src/cpu.c", "./src/emulator.c", "./src/fs.c", "./src/mapper.c");
+    nob_cc_inputs(&cmd, "./src/main.c", "./src/bench.c", EMULATOR_INPUTS);
+    cmd_append(&cmd, "-lm");
+
+    if (!cmd_run_sync_and_reset(&cmd)) {
+        return 1;
+    }
+
+    nob_cc(&cmd);
+    nob_cc_flags(&cmd);
+    cmd_append(&cmd, "-O2", "-pthread");
+    nob_cc_output(&cmd, "loyd-batch");
+    nob_cc_inputs(&cmd, "./src/batch.c", EMULATOR_INPUTS);
+    cmd_append(&cmd, "-lm");
 
     if (!cmd_run_sync_and_reset(&cmd)) {
         return 1;
     }
 
-    if (argc > 1) {
-        cmd_append(&cmd, "./loyd", argv[1]);
+    if (argc > 0) {
+        cmd_append(&cmd, "./loyd", argv[0]);
 
         if (!cmd_run_sync_and_reset(&cmd)) {
             return 1;
@@ -0,0 +1,819 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "apu.h"
+#include "audio.h"
+#include "clock.h"
+#include "state.h"
+
+// Output units per volume step of each channel, a linear approximation of the mixer that keeps everything
+// together under INT16_MAX
+#define APU_PULSE_WEIGHT 246
+#define APU_TRIANGLE_WEIGHT 279
+#define APU_NOISE_WEIGHT 162
+#define APU_DMC_WEIGHT 110
+
+// CPU cycles the DMC steals from the CPU for every byte it fetches
+#define APU_DMC_STALL 4
+
+static const uint8_t apu_length_table[32] = {
+    10, 254, 20, 2,  40, 4,  80, 6,  160, 8,  60, 10, 14, 12, 26, 14,
+    12, 16,  24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+};
+
+static const uint8_t apu_duty_table[4][8] = {
+    {0, 1, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 0, 0, 0, 0, 0},
+    {0, 1, 1, 1, 1, 0, 0, 0},
+    {1, 0, 0, 1, 1, 1, 1, 1},
+};
+
+static const uint8_t apu_triangle_table[32] = {
+    15, 14, 13, 12, 11, 10, 9,  8,  7,  6,  5,  4,  3,  2,  1,  0,
+    0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15,
+};
+
+// In CPU cycles
+static const uint16_t apu_noise_periods[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068,
+};
+
+static const uint16_t apu_dmc_periods[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54,
+};
+
+// CPU cycles from the start of the sequence to each step, and the length of the whole sequence
+static const uint32_t apu_frame_steps[2][4] = {
+    {7457, 14913, 22371, 29829},
+    {7457, 14913, 22371, 37281},
+};
+
+static const uint32_t apu_frame_periods[2] = {29830, 37282};
+
+static void apu_set_level(Apu *apu, int32_t *level, int32_t value, uint64_t clock) {
+    if (value == *level) {
+        return;
+    }
+
+    if (apu->output != NULL) {
+        blip_add_delta(&apu->blip, clock - apu->frame_start, value - *level);
+    }
+
+    *level = value;
+}
+
+static uint8_t apu_envelope_volume(ApuEnvelope *envelope) {
+    return envelope->constant ? envelope->period : envelope->decay;
+}
+
+static void apu_clock_envelope(ApuEnvelope *envelope) {
+    if (envelope->start) {
+        envelope->start = false;
+        envelope->decay = 15;
+        envelope->divider = envelope->period;
+    } else if (envelope->divider > 0) {
+        envelope->divider--;
+    } else {
+        envelope->divider = envelope->period;
+
+        if (envelope->decay > 0) {
+            envelope->decay--;
+        } else if (envelope->loop) {
+            envelope->decay = 15;
+        }
+    }
+}
+
+// Where the sweep unit would move the period, pulse 1 negates with the ones' complement
+static int apu_sweep_target(ApuPulse *pulse, int channel) {
+    int change = pulse->period >> pulse->sweep_shift;
+
+    if (pulse->sweep_negate) {
+        return pulse->period - change - (channel == 0);
+    }
+
+    return pulse->period + change;
+}
+
+static bool apu_pulse_muted(ApuPulse *pulse, int channel) {
+    return pulse->length == 0 || pulse->period < 8 || apu_sweep_target(pulse, channel) > 0x7ff;
+}
+
+static int32_t apu_pulse_level(ApuPulse *pulse, int channel) {
+    if (apu_pulse_muted(pulse, channel) || !apu_duty_table[pulse->duty][pulse->step]) {
+        return 0;
+    }
+
+    return apu_envelope_volume(&pulse->envelope) * APU_PULSE_WEIGHT;
+}
+
+static int32_t apu_triangle_level(ApuTriangle *triangle) {
+    return apu_triangle_table[triangle->step] * APU_TRIANGLE_WEIGHT;
+}
+
+static int32_t apu_noise_level(ApuNoise *noise) {
+    if (noise->length == 0 || (noise->shift & 1)) {
+        return 0;
+    }
+
+    return apu_envelope_volume(&noise->envelope) * APU_NOISE_WEIGHT;
+}
+
+// Timer periods in CPU cycles
+static uint64_t apu_pulse_period(ApuPulse *pulse) { return (pulse->period + 1) * 2; }
+static uint64_t apu_triangle_period(ApuTriangle *triangle) { return triangle->period + 1; }
+
+// Clocks a timer that cannot change the output from next up to clock in one go, returning how many clocks
+// were skipped
+static uint64_t apu_skip_timer(uint64_t *next, uint64_t period, uint64_t clock) {
+    uint64_t count = (clock - *next + period - 1) / period;
+
+    *next += count * period;
+
+    return count;
+}
+
+static void apu_run_pulse(Apu *apu, int channel, uint64_t clock) {
+    ApuPulse *pulse = &apu->pulses[channel];
+    uint64_t period = apu_pulse_period(pulse);
+
+    if (apu_pulse_muted(pulse, channel)) {
+        if (clock_is_before(pulse->next, clock)) {
+            pulse->step = (pulse->step + apu_skip_timer(&pulse->next, period, clock)) & 7;
+        }
+
+        return;
+    }
+
+    while (clock_is_before(pulse->next, clock)) {
+        pulse->step = (pulse->step + 1) & 7;
+        apu_set_level(apu, &pulse->level, apu_pulse_level(pulse, channel), pulse->next);
+        pulse->next += period;
+    }
+}
+
+static void apu_run_triangle(Apu *apu, uint64_t clock) {
+    ApuTriangle *triangle = &apu->triangle;
+    uint64_t period = apu_triangle_period(triangle);
+
+    // The sequencer holds still while either counter is zero. Periods under 2 are far above hearing and real
+    // hardware just produces a level in the middle, which is not worth stepping through at 1 MHz.
+    if (triangle->length == 0 || triangle->linear_counter == 0 || triangle->period < 2) {
+        if (clock_is_before(triangle->next, clock)) {
+            apu_skip_timer(&triangle->next, period, clock);
+        }
+
+        return;
+    }
+
+    while (clock_is_before(triangle->next, clock)) {
+        triangle->step = (triangle->step + 1) & 31;
+        apu_set_level(apu, &triangle->level, apu_triangle_level(triangle), triangle->next);
+        triangle->next += period;
+    }
+}
+
+static void apu_run_noise(Apu *apu, uint64_t clock) {
+    ApuNoise *noise = &apu->noise;
+    int tap = noise->short_mode ? 6 : 1;
+
+    if (noise->length == 0) {
+        if (clock_is_before(noise->next, clock)) {
+            apu_skip_timer(&noise->next, noise->period, clock);
+        }
+
+        return;
+    }
+
+    while (clock_is_before(noise->next, clock)) {
+        uint16_t feedback = (noise->shift ^ (noise->shift >> tap)) & 1;
+
+        noise->shift = (noise->shift >> 1) | (feedback << 14);
+        apu_set_level(apu, &noise->level, apu_noise_level(noise), noise->next);
+        noise->next += noise->period;
+    }
+}
+
+// Fills the sample buffer, when it is empty, from the next byte of the sample
+static void apu_dmc_fetch(Apu *apu) {
+    ApuDmc *dmc = &apu->dmc;
+
+    if (dmc->buffer_full || dmc->bytes_remaining == 0) {
+        return;
+    }
+
+    dmc->buffer = apu->read != NULL ? apu->read(apu->context, dmc->address) : 0;
+    dmc->buffer_full = true;
+    dmc->address = dmc->address == 0xffff ? 0x8000 : dmc->address + 1;
+    dmc->bytes_remaining--;
+    apu->stall += APU_DMC_STALL;
+
+    if (dmc->bytes_remaining == 0) {
+        if (dmc->loop) {
+            dmc->address = dmc->sample_address;
+            dmc->bytes_remaining = dmc->sample_length;
+        } else if (dmc->irq_enabled) {
+            dmc->irq = true;
+        }
+    }
+}
+
+static void apu_clock_dmc(Apu *apu) {
+    ApuDmc *dmc = &apu->dmc;
+
+    if (!dmc->silence) {
+        if (dmc->shift & 1) {
+            if (dmc->output <= 125) {
+                dmc->output += 2;
+            }
+        } else if (dmc->output >= 2) {
+            dmc->output -= 2;
+        }
+
+        dmc->shift >>= 1;
+        apu_set_level(apu, &dmc->level, dmc->output * APU_DMC_WEIGHT, dmc->next);
+    }
+
+    if (--dmc->bits_remaining > 0) {
+        return;
+    }
+
+    // The output cycle ends, the next one plays whatever the buffer holds
+    dmc->bits_remaining = 8;
+    dmc->silence = !dmc->buffer_full;
+
+    if (dmc->buffer_full) {
+        dmc->shift = dmc->buffer;
+        dmc->buffer_full = false;
+        apu_dmc_fetch(apu);
+    }
+}
+
+// Unlike the other channels the DMC always runs, since its fetches stall the CPU and can raise an IRQ
+static void apu_run_dmc(Apu *apu, uint64_t clock) {
+    ApuDmc *dmc = &apu->dmc;
+
+    while (clock_is_before(dmc->next, clock)) {
+        if (dmc->silence && !dmc->buffer_full && dmc->bytes_remaining == 0) {
+            // Nothing to play or fetch until $4015 restarts the sample, only the bit counter keeps turning
+            uint64_t count = apu_skip_timer(&dmc->next, dmc->period, clock);
+
+            dmc->bits_remaining = (dmc->bits_remaining + 7 - count % 8) % 8 + 1;
+
+            return;
+        }
+
+        apu_clock_dmc(apu);
+        dmc->next += dmc->period;
+    }
+}
+
+static void apu_run_channels(Apu *apu, uint64_t clock) {
+    if (apu->output != NULL) {
+        apu_run_pulse(apu, 0, clock);
+        apu_run_pulse(apu, 1, clock);
+        apu_run_triangle(apu, clock);
+        apu_run_noise(apu, clock);
+    }
+
+    apu_run_dmc(apu, clock);
+    apu->clock = clock;
+}
+
+// Recomputes the levels after something other than a timer changed them
+static void apu_update_levels(Apu *apu) {
+    uint64_t clock = apu->clock;
+
+    apu_set_level(apu, &apu->pulses[0].level, apu_pulse_level(&apu->pulses[0], 0), clock);
+    apu_set_level(apu, &apu->pulses[1].level, apu_pulse_level(&apu->pulses[1], 1), clock);
+    apu_set_level(apu, &apu->triangle.level, apu_triangle_level(&apu->triangle), clock);
+    apu_set_level(apu, &apu->noise.level, apu_noise_level(&apu->noise), clock);
+}
+
+static void apu_clock_quarter_frame(Apu *apu) {
+    apu_clock_envelope(&apu->pulses[0].envelope);
+    apu_clock_envelope(&apu->pulses[1].envelope);
+    apu_clock_envelope(&apu->noise.envelope);
+
+    ApuTriangle *triangle = &apu->triangle;
+
+    if (triangle->linear_reload) {
+        triangle->linear_counter = triangle->linear_reload_value;
+    } else if (triangle->linear_counter > 0) {
+        triangle->linear_counter--;
+    }
+
+    if (!triangle->control) {
+        triangle->linear_reload = false;
+    }
+}
+
+static void apu_clock_half_frame(Apu *apu) {
+    for (int channel = 0; channel < 2; channel++) {
+        ApuPulse *pulse = &apu->pulses[channel];
+
+        if (!pulse->envelope.loop && pulse->length > 0) {
+            pulse->length--;
+        }
+
+        int target = apu_sweep_target(pulse, channel);
+
+        if (pulse->sweep_divider == 0 && pulse->sweep_enabled && pulse->sweep_shift > 0 && pulse->period >= 8 &&
+            target <= 0x7ff) {
+            pulse->period = target;
+        }
+
+        if (pulse->sweep_divider == 0 || pulse->sweep_reload) {
+            pulse->sweep_divider = pulse->sweep_period;
+            pulse->sweep_reload = false;
+        } else {
+            pulse->sweep_divider--;
+        }
+    }
+
+    if (!apu->triangle.control && apu->triangle.length > 0) {
+        apu->triangle.length--;
+    }
+
+    if (!apu->noise.envelope.loop && apu->noise.length > 0) {
+        apu->noise.length--;
+    }
+}
+
+static void apu_frame_step(Apu *apu) {
+    apu_clock_quarter_frame(apu);
+
+    if (apu->frame_step & 1) {
+        apu_clock_half_frame(apu);
+    }
+
+    if (apu->frame_step == 3) {
+        if (!apu->five_step && !apu->irq_inhibit) {
+            apu->frame_irq = true;
+        }
+
+        apu->sequence_start += apu_frame_periods[apu->five_step];
+        apu->frame_step = 0;
+    } else {
+        apu->frame_step++;
+    }
+
+    apu_update_levels(apu);
+}
+
+void apu_power_on(Apu *apu) {
+    AudioRing *output = apu->output;
+    uint32_t sample_rate = apu->sample_rate;
+    void *context = apu->context;
+    uint8_t (*read)(void *, uint16_t) = apu->read;
+
+    memset(apu, 0, offsetof(Apu, blip));
+
+    apu->context = context;
+    apu->read = read;
+    apu->noise.shift = 1;
+    apu->noise.period = apu_noise_periods[0];
+    apu->dmc.period = apu_dmc_periods[0];
+    apu->dmc.bits_remaining = 8;
+    apu->dmc.silence = true;
+
+    apu_set_output(apu, output, sample_rate);
+}
+
+void apu_set_output(Apu *apu, AudioRing *output, uint32_t sample_rate) {
+    if (sample_rate > APU_MAX_SAMPLE_RATE) {
+        sample_rate = APU_MAX_SAMPLE_RATE;
+    }
+
+    apu->output = output;
+    apu->sample_rate = sample_rate;
+    apu->frame_start = apu->clock;
+
+    if (output == NULL) {
+        return;
+    }
+
+    blip_init(&apu->blip, APU_CLOCK_RATE, sample_rate);
+
+    // The timers did not run without an output, they pick up from now
+    ApuPulse *pulses = apu->pulses;
+    uint64_t *timers[] = {&pulses[0].next, &pulses[1].next, &apu->triangle.next, &apu->noise.next};
+
+    for (size_t i = 0; i < sizeof(timers) / sizeof(timers[0]); i++) {
+        if (clock_is_before(*timers[i], apu->clock)) {
+            *timers[i] = apu->clock;
+        }
+    }
+}
+
+uint64_t apu_next_frame_step(Apu *apu) {
+    return apu->sequence_start + apu_frame_steps[apu->five_step][apu->frame_step];
+}
+
+void apu_sync(Apu *apu, uint64_t master_clock) {
+    if (!clock_is_before(apu->clock, master_clock)) {
+        return;
+    }
+
+    // Channels run in stretches between frame counter steps, so every step sees the state at its own clock
+    uint64_t step;
+
+    while (!clock_is_before(master_clock, step = apu_next_frame_step(apu))) {
+        apu_run_channels(apu, step);
+        apu_frame_step(apu);
+    }
+
+    apu_run_channels(apu, master_clock);
+}
+
+void apu_end_frame(Apu *apu) {
+    if (apu->output == NULL) {
+        return;
+    }
+
+    int16_t samples[BLIP_CAPACITY];
+
+    blip_end_frame(&apu->blip, apu->clock - apu->frame_start);
+    apu->frame_start = apu->clock;
+
+    int count = blip_read_samples(&apu->blip, samples, BLIP_CAPACITY);
+
+    audio_ring_write(apu->output, samples, count);
+}
+
+bool apu_next_dmc_fetch(Apu *apu, uint64_t *master_clock) {
+    ApuDmc *dmc = &apu->dmc;
+
+    if (dmc->bytes_remaining == 0) {
+        return false;
+    }
+
+    // With bytes left the buffer is full, it empties into the shift register when the output cycle ends
+    *master_clock = dmc->next + (uint64_t)(dmc->bits_remaining - 1) * dmc->period;
+
+    return true;
+}
+
+bool apu_irq(Apu *apu) { return apu->frame_irq || apu->dmc.irq; }
+
+uint8_t apu_read_status(Apu *apu) {
+    uint8_t status = (apu->pulses[0].length > 0) | (apu->pulses[1].length > 0) << 1 |
+                     (apu->triangle.length > 0) << 2 | (apu->noise.length > 0) << 3 |
+                     (apu->dmc.bytes_remaining > 0) << 4 | apu->frame_irq << 6 | apu->dmc.irq << 7;
+
+    apu->frame_irq = false;
+
+    return status;
+}
+
+static void apu_write_envelope(ApuEnvelope *envelope, uint8_t byte) {
+    envelope->loop = byte & 0x20;
+    envelope->constant = byte & 0x10;
+    envelope->period = byte & 0x0f;
+}
+
+static void apu_write_pulse(Apu *apu, int channel, uint16_t pointer, uint8_t byte) {
+    ApuPulse *pulse = &apu->pulses[channel];
+
+    switch (pointer & 3) {
+    case 0:
+        pulse->duty = byte >> 6;
+        apu_write_envelope(&pulse->envelope, byte);
+        break;
+
+    case 1:
+        pulse->sweep_enabled = byte & 0x80;
+        pulse->sweep_period = (byte >> 4) & 7;
+        pulse->sweep_negate = byte & 0x08;
+        pulse->sweep_shift = byte & 7;
+        pulse->sweep_reload = true;
+        break;
+
+    case 2:
+        pulse->period = (pulse->period & 0x700) | byte;
+        break;
+
+    case 3:
+        pulse->period = (pulse->period & 0xff) | (byte & 7) << 8;
+        pulse->step = 0;
+        pulse->envelope.start = true;
+
+        if (apu->enabled & (1 << channel)) {
+            pulse->length = apu_length_table[byte >> 3];
+        }
+        break;
+    }
+}
+
+static void apu_write_status(Apu *apu, uint8_t byte) {
+    apu->enabled = byte & 0x1f;
+
+    if (!(byte & 0x01)) {
+        apu->pulses[0].length = 0;
+    }
+
+    if (!(byte & 0x02)) {
+        apu->pulses[1].length = 0;
+    }
+
+    if (!(byte & 0x04)) {
+        apu->triangle.length = 0;
+    }
+
+    if (!(byte & 0x08)) {
+        apu->noise.length = 0;
+    }
+
+    ApuDmc *dmc = &apu->dmc;
+
+    dmc->irq = false;
+
+    if (!(byte & 0x10)) {
+        dmc->bytes_remaining = 0;
+    } else if (dmc->bytes_remaining == 0) {
+        dmc->address = dmc->sample_address;
+        dmc->bytes_remaining = dmc->sample_length;
+        apu_dmc_fetch(apu);
+    }
+}
+
+static void apu_write_frame_counter(Apu *apu, uint8_t byte) {
+    apu->five_step = byte & 0x80;
+    apu->irq_inhibit = byte & 0x40;
+
+    if (apu->irq_inhibit) {
+        apu->frame_irq = false;
+    }
+
+    // The sequence restarts a few cycles after the write, the five step one clocks everything right away
+    apu->sequence_start = apu->clock + 3 + (apu->clock & 1);
+    apu->frame_step = 0;
+
+    if (apu->five_step) {
+        apu_clock_quarter_frame(apu);
+        apu_clock_half_frame(apu);
+    }
+}
+
+void apu_write_register(Apu *apu, uint16_t pointer, uint8_t byte) {
+    switch (pointer) {
+    case 0x4000:
+    case 0x4001:
+    case 0x4002:
+    case 0x4003:
+        apu_write_pulse(apu, 0, pointer, byte);
+        break;
+
+    case 0x4004:
+    case 0x4005:
+    case 0x4006:
+    case 0x4007:
+        apu_write_pulse(apu, 1, pointer, byte);
+        break;
+
+    case 0x4008:
+        apu->triangle.control = byte & 0x80;
+        apu->triangle.linear_reload_value = byte & 0x7f;
+        break;
+
+    case 0x400a:
+        apu->triangle.period = (apu->triangle.period & 0x700) | byte;
+        break;
+
+    case 0x400b:
+        apu->triangle.period = (apu->triangle.period & 0xff) | (byte & 7) << 8;
+        apu->triangle.linear_reload = true;
+
+        if (apu->enabled & 0x04) {
+            apu->triangle.length = apu_length_table[byte >> 3];
+        }
+        break;
+
+    case 0x400c:
+        apu_write_envelope(&apu->noise.envelope, byte);
+        break;
+
+    case 0x400e:
+        apu->noise.short_mode = byte & 0x80;
+        apu->noise.period = apu_noise_periods[byte & 0x0f];
+        break;
+
+    case 0x400f:
+        apu->noise.envelope.start = true;
+
+        if (apu->enabled & 0x08) {
+            apu->noise.length = apu_length_table[byte >> 3];
+        }
+        break;
+
+    case 0x4010:
+        apu->dmc.irq_enabled = byte & 0x80;
+        apu->dmc.loop = byte & 0x40;
+        apu->dmc.period = apu_dmc_periods[byte & 0x0f];
+
+        if (!apu->dmc.irq_enabled) {
+            apu->dmc.irq = false;
+        }
+        break;
+
+    case 0x4011:
+        apu->dmc.output = byte & 0x7f;
+        apu_set_level(apu, &apu->dmc.level, apu->dmc.output * APU_DMC_WEIGHT, apu->clock);
+        break;
+
+    case 0x4012:
+        apu->dmc.sample_address = 0xc000 | (byte << 6);
+        break;
+
+    case 0x4013:
+        apu->dmc.sample_length = (byte << 4) + 1;
+        break;
+
+    case 0x4015:
+        apu_write_status(apu, byte);
+        break;
+
+    case 0x4017:
+        apu_write_frame_counter(apu, byte);
+        break;
+    }
+
+    apu_update_levels(apu);
+}
+
+static void apu_save_envelope(ApuEnvelope *envelope, StateWriter *writer) {
+    state_write_u8(writer, envelope->start);
+    state_write_u8(writer, envelope->loop);
+    state_write_u8(writer, envelope->constant);
+    state_write_u8(writer, envelope->period);
+    state_write_u8(writer, envelope->divider);
+    state_write_u8(writer, envelope->decay);
+}
+
+static void apu_load_envelope(ApuEnvelope *envelope, StateReader *reader) {
+    envelope->start = state_read_u8(reader) != 0;
+    envelope->loop = state_read_u8(reader) != 0;
+    envelope->constant = state_read_u8(reader) != 0;
+    envelope->period = state_read_u8(reader);
+    envelope->divider = state_read_u8(reader);
+    envelope->decay = state_read_u8(reader);
+}
+
+void apu_save_state(Apu *apu, StateWriter *writer) {
+    for (int channel = 0; channel < 2; channel++) {
+        ApuPulse *pulse = &apu->pulses[channel];
+
+        apu_save_envelope(&pulse->envelope, writer);
+        state_write_u8(writer, pulse->duty);
+        state_write_u8(writer, pulse->step);
+        state_write_u16(writer, pulse->period);
+        state_write_u8(writer, pulse->length);
+        state_write_u8(writer, pulse->sweep_enabled);
+        state_write_u8(writer, pulse->sweep_negate);
+        state_write_u8(writer, pulse->sweep_reload);
+        state_write_u8(writer, pulse->sweep_period);
+        state_write_u8(writer, pulse->sweep_shift);
+        state_write_u8(writer, pulse->sweep_divider);
+        state_write_u64(writer, pulse->next);
+    }
+
+    ApuTriangle *triangle = &apu->triangle;
+
+    state_write_u8(writer, triangle->control);
+    state_write_u8(writer, triangle->linear_reload);
+    state_write_u8(writer, triangle->linear_reload_value);
+    state_write_u8(writer, triangle->linear_counter);
+    state_write_u8(writer, triangle->step);
+    state_write_u16(writer, triangle->period);
+    state_write_u8(writer, triangle->length);
+    state_write_u64(writer, triangle->next);
+
+    ApuNoise *noise = &apu->noise;
+
+    apu_save_envelope(&noise->envelope, writer);
+    state_write_u8(writer, noise->short_mode);
+    state_write_u16(writer, noise->shift);
+    state_write_u16(writer, noise->period);
+    state_write_u8(writer, noise->length);
+    state_write_u64(writer, noise->next);
+
+    ApuDmc *dmc = &apu->dmc;
+
+    state_write_u8(writer, dmc->irq_enabled);
+    state_write_u8(writer, dmc->loop);
+    state_write_u8(writer, dmc->irq);
+    state_write_u16(writer, dmc->period);
+    state_write_u8(writer, dmc->output);
+    state_write_u16(writer, dmc->sample_address);
+    state_write_u16(writer, dmc->sample_length);
+    state_write_u16(writer, dmc->address);
+    state_write_u16(writer, dmc->bytes_remaining);
+    state_write_u8(writer, dmc->buffer);
+    state_write_u8(writer, dmc->buffer_full);
+    state_write_u8(writer, dmc->shift);
+    state_write_u8(writer, dmc->bits_remaining);
+    state_write_u8(writer, dmc->silence);
+    state_write_u64(writer, dmc->next);
+
+    state_write_u8(writer, apu->enabled);
+    state_write_u8(writer, apu->five_step);
+    state_write_u8(writer, apu->irq_inhibit);
+    state_write_u8(writer, apu->frame_irq);
+    state_write_u8(writer, apu->frame_step);
+    state_write_u64(writer, apu->sequence_start);
+    state_write_u64(writer, apu->clock);
+    state_write_u64(writer, apu->stall);
+}
+
+void apu_load_state(Apu *apu, StateReader *reader) {
+    for (int channel = 0; channel < 2; channel++) {
+        ApuPulse *pulse = &apu->pulses[channel];
+
+        apu_load_envelope(&pulse->envelope, reader);
+        pulse->duty = state_read_u8(reader) & 3;
+        pulse->step = state_read_u8(reader) & 7;
+        pulse->period = state_read_u16(reader) & 0x7ff;
+        pulse->length = state_read_u8(reader);
+        pulse->sweep_enabled = state_read_u8(reader) != 0;
+        pulse->sweep_negate = state_read_u8(reader) != 0;
+        pulse->sweep_reload = state_read_u8(reader) != 0;
+        pulse->sweep_period = state_read_u8(reader);
+        pulse->sweep_shift = state_read_u8(reader) & 7;
+        pulse->sweep_divider = state_read_u8(reader);
+        pulse->next = state_read_u64(reader);
+    }
+
+    ApuTriangle *triangle = &apu->triangle;
+
+    triangle->control = state_read_u8(reader) != 0;
+    triangle->linear_reload = state_read_u8(reader) != 0;
+    triangle->linear_reload_value = state_read_u8(reader);
+    triangle->linear_counter = state_read_u8(reader);
+    triangle->step = state_read_u8(reader) & 31;
+    triangle->period = state_read_u16(reader) & 0x7ff;
+    triangle->length = state_read_u8(reader);
+    triangle->next = state_read_u64(reader);
+
+    ApuNoise *noise = &apu->noise;
+
+    apu_load_envelope(&noise->envelope, reader);
+    noise->short_mode = state_read_u8(reader) != 0;
+    noise->shift = state_read_u16(reader);
+    noise->period = state_read_u16(reader);
+    noise->length = state_read_u8(reader);
+    noise->next = state_read_u64(reader);
+
+    ApuDmc *dmc = &apu->dmc;
+
+    dmc->irq_enabled = state_read_u8(reader) != 0;
+    dmc->loop = state_read_u8(reader) != 0;
+    dmc->irq = state_read_u8(reader) != 0;
+    dmc->period = state_read_u16(reader);
+    dmc->output = state_read_u8(reader) & 0x7f;
+    dmc->sample_address = state_read_u16(reader);
+    dmc->sample_length = state_read_u16(reader);
+    dmc->address = state_read_u16(reader);
+    dmc->bytes_remaining = state_read_u16(reader);
+    dmc->buffer = state_read_u8(reader);
+    dmc->buffer_full = state_read_u8(reader) != 0;
+    dmc->shift = state_read_u8(reader);
+    dmc->bits_remaining = state_read_u8(reader);
+    dmc->silence = state_read_u8(reader) != 0;
+    dmc->next = state_read_u64(reader);
+
+    apu->enabled = state_read_u8(reader);
+    apu->five_step = state_read_u8(reader) != 0;
+    apu->irq_inhibit = state_read_u8(reader) != 0;
+    apu->frame_irq = state_read_u8(reader) != 0;
+    apu->frame_step = state_read_u8(reader) & 3;
+    apu->sequence_start = state_read_u64(reader);
+    apu->clock = state_read_u64(reader);
+    apu->stall = state_read_u64(reader);
+
+    // Zero periods would stall the timers forever, they can only come from a damaged state
+    if (noise->period == 0) {
+        noise->period = apu_noise_periods[0];
+    }
+
+    if (dmc->period == 0) {
+        dmc->period = apu_dmc_periods[0];
+    }
+
+    if (dmc->bits_remaining == 0 || dmc->bits_remaining > 8) {
+        dmc->bits_remaining = 8;
+    }
+
+    // Levels are what the channels are playing right now, and the audio restarts from here
+    apu->pulses[0].level = apu_pulse_level(&apu->pulses[0], 0);
+    apu->pulses[1].level = apu_pulse_level(&apu->pulses[1], 1);
+    apu->triangle.level = apu_triangle_level(&apu->triangle);
+    apu->noise.level = apu_noise_level(&apu->noise);
+    apu->dmc.level = apu->dmc.output * APU_DMC_WEIGHT;
+    apu->frame_start = apu->clock;
+
+    if (apu->output != NULL) {
+        blip_clear(&apu->blip);
+    }
+}
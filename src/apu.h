@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "state.h"
+
+// NTSC CPU clock, the APU counts time in the same cycles as everything else
+#define APU_CLOCK_RATE 1789773.0
+
+// Highest output rate, one frame of it has to fit in a Blip
+#define APU_MAX_SAMPLE_RATE 192000
+
+typedef struct {
+    bool start;
+    // Shared with the length counter halt flag
+    bool loop;
+    bool constant;
+    // Either the constant volume or the divider period
+    uint8_t period;
+    uint8_t divider;
+    uint8_t decay;
+} ApuEnvelope;
+
+typedef struct {
+    ApuEnvelope envelope;
+    uint8_t duty;
+    uint8_t step;
+    uint16_t period;
+    uint8_t length;
+
+    bool sweep_enabled;
+    bool sweep_negate;
+    bool sweep_reload;
+    uint8_t sweep_period;
+    uint8_t sweep_shift;
+    uint8_t sweep_divider;
+
+    // Master clock of the next timer clock
+    uint64_t next;
+    // Contribution to the mix, in output units
+    int32_t level;
+} ApuPulse;
+
+typedef struct {
+    bool control;
+    bool linear_reload;
+    uint8_t linear_reload_value;
+    uint8_t linear_counter;
+    uint8_t step;
+    uint16_t period;
+    uint8_t length;
+    uint64_t next;
+    int32_t level;
+} ApuTriangle;
+
+typedef struct {
+    ApuEnvelope envelope;
+    bool short_mode;
+    uint16_t shift;
+    uint16_t period;
+    uint8_t length;
+    uint64_t next;
+    int32_t level;
+} ApuNoise;
+
+typedef struct {
+    bool irq_enabled;
+    bool loop;
+    bool irq;
+    uint16_t period;
+    uint8_t output;
+
+    uint16_t sample_address;
+    uint16_t sample_length;
+    uint16_t address;
+    uint16_t bytes_remaining;
+
+    uint8_t buffer;
+    bool buffer_full;
+    uint8_t shift;
+    uint8_t bits_remaining;
+    bool silence;
+
+    uint64_t next;
+    int32_t level;
+} ApuDmc;
+
+typedef struct {
+    ApuPulse pulses[2];
+    ApuTriangle triangle;
+    ApuNoise noise;
+    ApuDmc dmc;
+    // Enable bits written to $4015
+    uint8_t enabled;
+
+    // Frame counter: five_step selects the sequence, sequence_start is the master clock it started at
+    bool five_step;
+    bool irq_inhibit;
+    bool frame_irq;
+    uint8_t frame_step;
+    uint64_t sequence_start;
+
+    // Master clock the APU has been run up to
+    uint64_t clock;
+
+    // How the DMC fetches samples, set up by the emulator
+    void *context;
+    uint8_t (*read)(void *context, uint16_t pointer);
+    // CPU cycles the DMC took from the CPU since the emulator last collected them
+    uint64_t stall;
+
+    // Owned by the caller, or NULL to only run what games can observe: length counters, IRQs and the DMC
+    AudioRing *output;
+    uint32_t sample_rate;
+    // Master clock the current audio frame started at
+    uint64_t frame_start;
+    Blip blip;
+} Apu;
+
+void apu_power_on(Apu *);
+// sample_rate is clamped to APU_MAX_SAMPLE_RATE
+void apu_set_output(Apu *, AudioRing *output, uint32_t sample_rate);
+
+// Runs the APU up to the given master clock
+void apu_sync(Apu *, uint64_t master_clock);
+// Resamples everything since the previous call and pushes it into the output, called once per video frame
+void apu_end_frame(Apu *);
+
+// The master clock of the next frame counter step, the deadline for length counters and the frame IRQ
+uint64_t apu_next_frame_step(Apu *);
+// The master clock of the next DMC sample fetch, false when the DMC has nothing left to fetch
+bool apu_next_dmc_fetch(Apu *, uint64_t *master_clock);
+// Level of the IRQ line, held until the game acknowledges it
+bool apu_irq(Apu *);
+
+uint8_t apu_read_status(Apu *);
+void apu_write_register(Apu *, uint16_t pointer, uint8_t byte);
+
+// Every channel and the frame counter, the audio already produced is not part of it
+void apu_save_state(Apu *, StateWriter *);
+void apu_load_state(Apu *, StateReader *);
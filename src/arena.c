@@ -0,0 +1,50 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+void arena_init(Arena *arena, void *memory, size_t capacity) {
+    arena->memory = memory;
+    arena->capacity = capacity;
+    arena->used = 0;
+}
+
+// Where the next allocation starts, aligned on the actual address so any block of memory works
+static size_t arena_next(Arena *arena) {
+    uintptr_t address = (uintptr_t)arena->memory + arena->used;
+    uintptr_t aligned = (address + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1);
+
+    return aligned - (uintptr_t)arena->memory;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size_t start = arena_next(arena);
+
+    if (start > arena->capacity || size > arena->capacity - start) {
+        return NULL;
+    }
+
+    arena->used = start + size;
+
+    return arena->memory + start;
+}
+
+void *arena_tail(Arena *arena, size_t *available) {
+    size_t start = arena_next(arena);
+
+    if (start > arena->capacity) {
+        *available = 0;
+
+        return NULL;
+    }
+
+    *available = arena->capacity - start;
+
+    return arena->memory + start;
+}
+
+size_t arena_mark(Arena *arena) { return arena->used; }
+
+void arena_rewind(Arena *arena, size_t mark) { arena->used = mark; }
+
+void arena_reset(Arena *arena) { arena->used = 0; }
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every allocation is 64 byte aligned, so nothing allocated from an arena shares a cache line with a neighbour
+#define ARENA_ALIGNMENT 64
+
+// A bump allocator over one block of memory. Nothing is freed on its own, the whole arena is reset at once or
+// rewound to an earlier mark.
+typedef struct {
+    uint8_t *memory;
+    size_t capacity;
+    size_t used;
+} Arena;
+
+// memory is owned by the caller and holds capacity bytes
+void arena_init(Arena *, void *memory, size_t capacity);
+
+// Returns NULL when the arena is out of room. The memory is not cleared.
+void *arena_alloc(Arena *, size_t size);
+
+// The free space at the end of the arena, for data whose size is only known once it has been written there.
+// An arena_alloc of the size written right after claims it.
+void *arena_tail(Arena *, size_t *available);
+
+// Frees everything allocated since arena_mark returned mark
+size_t arena_mark(Arena *);
+void arena_rewind(Arena *, size_t mark);
+
+void arena_reset(Arena *);
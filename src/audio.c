@@ -0,0 +1,168 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "audio.h"
+
+// Cutoff of the step kernel in cycles per output sample, a little under Nyquist
+#define BLIP_CUTOFF 0.45
+
+// How quickly the high-pass filter forgets the DC offset, higher is slower
+#define BLIP_BASS_SHIFT 9
+
+void blip_init(Blip *blip, double clock_rate, double sample_rate) {
+    blip->factor = (uint64_t)(sample_rate / clock_rate * 4294967296.0);
+
+    // Every phase is the impulse of a step that lands that fraction of a sample late, windowed with Blackman
+    // and scaled so its taps add up to exactly one unit
+    for (int phase = 0; phase < BLIP_PHASES; phase++) {
+        double taps[BLIP_TAPS];
+        double sum = 0;
+
+        for (int i = 0; i < BLIP_TAPS; i++) {
+            double t = i - (BLIP_TAPS / 2 - 1) - (double)phase / BLIP_PHASES;
+            double x = t / (BLIP_TAPS / 2);
+            double window = 0.42 + 0.5 * cos(M_PI * x) + 0.08 * cos(2 * M_PI * x);
+            double sinc = t == 0 ? 2 * BLIP_CUTOFF : sin(2 * M_PI * BLIP_CUTOFF * t) / (M_PI * t);
+
+            taps[i] = sinc * window;
+            sum += taps[i];
+        }
+
+        int32_t total = 0;
+        int largest = 0;
+
+        for (int i = 0; i < BLIP_TAPS; i++) {
+            blip->kernel[phase][i] = (int16_t)lround(taps[i] / sum * (1 << BLIP_KERNEL_BITS));
+            total += blip->kernel[phase][i];
+
+            if (blip->kernel[phase][i] > blip->kernel[phase][largest]) {
+                largest = i;
+            }
+        }
+
+        // Rounding must not leave a step slightly too big or small, it would add up to a drift
+        blip->kernel[phase][largest] += (1 << BLIP_KERNEL_BITS) - total;
+    }
+
+    blip_clear(blip);
+}
+
+void blip_clear(Blip *blip) {
+    blip->offset = 0;
+    blip->integrator = 0;
+
+    memset(blip->buffer, 0, sizeof(blip->buffer));
+}
+
+void blip_add_delta(Blip *blip, uint32_t time, int32_t delta) {
+    uint64_t position = blip->offset + time * blip->factor;
+    uint64_t index = position >> 32;
+
+    if (index >= BLIP_CAPACITY) {
+        return;
+    }
+
+    const int16_t *kernel = blip->kernel[(position >> (32 - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1)];
+    int32_t *buffer = blip->buffer + index;
+
+    for (int i = 0; i < BLIP_TAPS; i++) {
+        buffer[i] += kernel[i] * delta;
+    }
+}
+
+void blip_end_frame(Blip *blip, uint32_t clocks) {
+    blip->offset += clocks * blip->factor;
+
+    // Only happens when nobody reads the samples, drop the oldest ones
+    if ((blip->offset >> 32) > BLIP_CAPACITY) {
+        blip_clear(blip);
+    }
+}
+
+int blip_samples_available(Blip *blip) { return blip->offset >> 32; }
+
+int blip_read_samples(Blip *blip, int16_t *samples, int count) {
+    int available = blip_samples_available(blip);
+
+    if (count > available) {
+        count = available;
+    }
+
+    int32_t sum = blip->integrator;
+
+    for (int i = 0; i < count; i++) {
+        int32_t sample = sum >> BLIP_KERNEL_BITS;
+
+        sum += blip->buffer[i];
+
+        if (sample < INT16_MIN) {
+            sample = INT16_MIN;
+        } else if (sample > INT16_MAX) {
+            sample = INT16_MAX;
+        }
+
+        samples[i] = sample;
+        sum -= sample << (BLIP_KERNEL_BITS - BLIP_BASS_SHIFT);
+    }
+
+    blip->integrator = sum;
+
+    // Move what is left, including the tails of the kernels, to the front
+    int remaining = available - count + BLIP_TAPS;
+
+    memmove(blip->buffer, blip->buffer + count, remaining * sizeof(int32_t));
+    memset(blip->buffer + remaining, 0, count * sizeof(int32_t));
+
+    blip->offset -= (uint64_t)count << 32;
+
+    return count;
+}
+
+void audio_ring_init(AudioRing *ring, int16_t *storage, size_t capacity) {
+    ring->samples = storage;
+    ring->capacity = capacity;
+
+    atomic_init(&ring->write_index, 0);
+    atomic_init(&ring->read_index, 0);
+}
+
+size_t audio_ring_write(AudioRing *ring, const int16_t *samples, size_t count) {
+    size_t write = atomic_load_explicit(&ring->write_index, memory_order_relaxed);
+    size_t read = atomic_load_explicit(&ring->read_index, memory_order_acquire);
+    size_t space = ring->capacity - (write - read);
+
+    if (count > space) {
+        count = space;
+    }
+
+    size_t start = write & (ring->capacity - 1);
+    size_t first = count < ring->capacity - start ? count : ring->capacity - start;
+
+    memcpy(ring->samples + start, samples, first * sizeof(int16_t));
+    memcpy(ring->samples, samples + first, (count - first) * sizeof(int16_t));
+
+    atomic_store_explicit(&ring->write_index, write + count, memory_order_release);
+
+    return count;
+}
+
+size_t audio_ring_read(AudioRing *ring, int16_t *samples, size_t count) {
+    size_t read = atomic_load_explicit(&ring->read_index, memory_order_relaxed);
+    size_t write = atomic_load_explicit(&ring->write_index, memory_order_acquire);
+
+    if (count > write - read) {
+        count = write - read;
+    }
+
+    size_t start = read & (ring->capacity - 1);
+    size_t first = count < ring->capacity - start ? count : ring->capacity - start;
+
+    memcpy(samples, ring->samples + start, first * sizeof(int16_t));
+    memcpy(samples + first, ring->samples, (count - first) * sizeof(int16_t));
+
+    atomic_store_explicit(&ring->read_index, read + count, memory_order_release);
+
+    return count;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLIP_PHASE_BITS 5
+#define BLIP_PHASES (1 << BLIP_PHASE_BITS)
+#define BLIP_TAPS 16
+#define BLIP_KERNEL_BITS 14
+
+// Samples one frame can produce, enough for the highest rate apu_set_output accepts
+#define BLIP_CAPACITY 4096
+
+// Band-limited synthesis: a signal is described by the times and sizes of its steps, each one is drawn as a
+// windowed sinc so nothing above the output Nyquist frequency aliases back in, and the output is the running
+// sum of the steps.
+typedef struct {
+    // Output samples per clock, 32.32 fixed point
+    uint64_t factor;
+    // Position of the start of the frame in output samples, 32.32 fixed point
+    uint64_t offset;
+    int32_t integrator;
+    int16_t kernel[BLIP_PHASES][BLIP_TAPS];
+    int32_t buffer[BLIP_CAPACITY + BLIP_TAPS];
+} Blip;
+
+void blip_init(Blip *, double clock_rate, double sample_rate);
+void blip_clear(Blip *);
+// time is in clocks since the start of the frame
+void blip_add_delta(Blip *, uint32_t time, int32_t delta);
+void blip_end_frame(Blip *, uint32_t clocks);
+int blip_samples_available(Blip *);
+// Returns how many samples were read, after a high-pass filter that removes the DC offset
+int blip_read_samples(Blip *, int16_t *samples, int count);
+
+// Single producer, single consumer ring of samples that needs no locks: the emulator writes, a host audio
+// thread or a file writer reads
+typedef struct {
+    int16_t *samples;
+    // A power of two
+    size_t capacity;
+    _Alignas(64) _Atomic size_t write_index;
+    _Alignas(64) _Atomic size_t read_index;
+} AudioRing;
+
+// storage holds capacity samples, capacity has to be a power of two
+void audio_ring_init(AudioRing *, int16_t *storage, size_t capacity);
+// Both return how many samples they moved, the writer drops what does not fit
+size_t audio_ring_write(AudioRing *, const int16_t *samples, size_t count);
+size_t audio_ring_read(AudioRing *, int16_t *samples, size_t count);
@@ -0,0 +1,451 @@
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "emulator.h"
+
+// How many cycles to run between checks of the budgets
+#define BATCH_SLICE_CYCLES (64 * 1024)
+
+typedef enum {
+    RESULT_STOPPED,
+    RESULT_CYCLE_BUDGET,
+    RESULT_TIME_BUDGET,
+    RESULT_FAULT,
+    RESULT_STATUS_COUNT,
+} ResultStatus;
+
+static const char *result_status_names[] = {
+    [RESULT_STOPPED] = "stopped",
+    [RESULT_CYCLE_BUDGET] = "cycle_budget",
+    [RESULT_TIME_BUDGET] = "time_budget",
+    [RESULT_FAULT] = "fault",
+};
+
+typedef struct {
+    ResultStatus status;
+    uint64_t cycles;
+    double seconds;
+    Fault fault;
+} Result;
+
+// A contiguous range of ROM indices, the owner takes ROMs from the front and thieves take the back half
+typedef struct {
+    pthread_mutex_t lock;
+    size_t begin;
+    size_t end;
+} WorkQueue;
+
+typedef struct Batch Batch;
+
+typedef struct {
+    Batch *batch;
+    size_t index;
+    pthread_t thread;
+    WorkQueue queue;
+    // Every emulator the worker runs is created in here and gone when it is reset for the next ROM
+    Arena arena;
+} Worker;
+
+struct Batch {
+    char **rom_paths;
+    size_t rom_count;
+    Result *results;
+    Worker *workers;
+    size_t worker_count;
+    uint64_t cycle_budget;
+    double time_budget;
+};
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static bool work_queue_pop(WorkQueue *queue, size_t *rom_index) {
+    pthread_mutex_lock(&queue->lock);
+
+    bool found = queue->begin < queue->end;
+
+    if (found) {
+        *rom_index = queue->begin++;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return found;
+}
+
+// Moves the back half of another worker's queue into ours, returns false once every queue is empty
+static bool worker_steal(Worker *worker) {
+    Batch *batch = worker->batch;
+
+    for (size_t i = 1; i < batch->worker_count; i++) {
+        WorkQueue *victim = &batch->workers[(worker->index + i) % batch->worker_count].queue;
+
+        pthread_mutex_lock(&victim->lock);
+
+        size_t remaining = victim->end - victim->begin;
+        size_t begin = victim->end - (remaining + 1) / 2;
+        size_t end = victim->end;
+
+        victim->end = begin;
+
+        pthread_mutex_unlock(&victim->lock);
+
+        if (begin < end) {
+            pthread_mutex_lock(&worker->queue.lock);
+            worker->queue.begin = begin;
+            worker->queue.end = end;
+            pthread_mutex_unlock(&worker->queue.lock);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void worker_run_rom(Worker *worker, size_t rom_index) {
+    Batch *batch = worker->batch;
+    Result *result = &batch->results[rom_index];
+
+    double start = now();
+
+    arena_reset(&worker->arena);
+
+    Emulator *emulator = emulator_create(&worker->arena);
+
+    if (!emulator_load_rom(emulator, batch->rom_paths[rom_index])) {
+        result->status = RESULT_FAULT;
+        result->fault = *emulator_fault(emulator);
+        result->seconds = now() - start;
+
+        return;
+    }
+
+    result->status = RESULT_STOPPED;
+
+    while (!emulator_stopped(emulator)) {
+        uint64_t slice = BATCH_SLICE_CYCLES;
+
+        if (batch->cycle_budget != 0) {
+            uint64_t remaining = batch->cycle_budget - emulator->master_clock;
+
+            if (remaining == 0) {
+                result->status = RESULT_CYCLE_BUDGET;
+                break;
+            }
+
+            if (remaining < slice) {
+                slice = remaining;
+            }
+        }
+
+        if (batch->time_budget != 0 && now() - start >= batch->time_budget) {
+            result->status = RESULT_TIME_BUDGET;
+            break;
+        }
+
+        if (emulator_step(emulator, slice) != FAULT_NONE) {
+            result->status = RESULT_FAULT;
+            result->fault = *emulator_fault(emulator);
+            break;
+        }
+    }
+
+    result->cycles = emulator->cpu.cycles;
+    result->seconds = now() - start;
+
+    // Resetting the arena takes back everything but the mapped ROM
+    emulator_unload_rom(emulator);
+}
+
+static void *worker_main(void *argument) {
+    Worker *worker = argument;
+
+    while (true) {
+        size_t rom_index;
+
+        if (work_queue_pop(&worker->queue, &rom_index)) {
+            worker_run_rom(worker, rom_index);
+        } else if (!worker_steal(worker)) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void write_json_string(FILE *file, const char *string) {
+    fputc('"', file);
+
+    for (const char *c = string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(file, "\\u%04x", *c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+static void write_summary(Batch *batch, FILE *file, double seconds) {
+    uint64_t total_cycles = 0;
+    size_t status_counts[RESULT_STATUS_COUNT] = {0};
+
+    fprintf(file, "{\n  \"roms\": [\n");
+
+    for (size_t i = 0; i < batch->rom_count; i++) {
+        Result *result = &batch->results[i];
+
+        total_cycles += result->cycles;
+        status_counts[result->status]++;
+
+        fprintf(file, "    {\"path\": ");
+        write_json_string(file, batch->rom_paths[i]);
+        fprintf(file, ", \"status\": \"%s\", \"cycles\": %llu, \"seconds\": %.6f",
+                result_status_names[result->status], (unsigned long long)result->cycles, result->seconds);
+
+        if (result->status == RESULT_FAULT) {
+            fprintf(file, ", \"fault\": ");
+            write_json_string(file, result->fault.message);
+        }
+
+        fprintf(file, "}%s\n", i + 1 < batch->rom_count ? "," : "");
+    }
+
+    fprintf(file, "  ],\n");
+    fprintf(file, "  \"workers\": %zu,\n", batch->worker_count);
+    fprintf(file, "  \"seconds\": %.6f,\n", seconds);
+    fprintf(file, "  \"cycles\": %llu,\n", (unsigned long long)total_cycles);
+
+    for (size_t i = 0; i < RESULT_STATUS_COUNT; i++) {
+        fprintf(file, "  \"%s\": %zu%s\n", result_status_names[i], status_counts[i],
+                i + 1 < RESULT_STATUS_COUNT ? "," : "");
+    }
+
+    fprintf(file, "}\n");
+}
+
+// Reads one ROM path per line, skipping empty lines
+static char **read_rom_list(const char *path, size_t *count) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+
+    if (file == NULL) {
+        fprintf(stderr, "error: could not open file '%s': %s\n", path, strerror(errno));
+
+        return NULL;
+    }
+
+    size_t capacity = 64;
+    char **paths = malloc(capacity * sizeof(char *));
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+    bool out_of_memory = paths == NULL;
+
+    *count = 0;
+
+    while (!out_of_memory && (length = getline(&line, &line_capacity, file)) >= 0) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+
+        if (length == 0) {
+            continue;
+        }
+
+        if (*count == capacity) {
+            char **grown = realloc(paths, 2 * capacity * sizeof(char *));
+
+            if (grown == NULL) {
+                out_of_memory = true;
+                break;
+            }
+
+            paths = grown;
+            capacity *= 2;
+        }
+
+        char *copy = strdup(line);
+
+        if (copy == NULL) {
+            out_of_memory = true;
+            break;
+        }
+
+        paths[(*count)++] = copy;
+    }
+
+    free(line);
+
+    if (file != stdin) {
+        fclose(file);
+    }
+
+    if (out_of_memory) {
+        fprintf(stderr, "error: out of memory\n");
+
+        for (size_t i = 0; i < *count; i++) {
+            free(paths[i]);
+        }
+
+        free(paths);
+
+        return NULL;
+    }
+
+    return paths;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [options] <rom-list>\n", program);
+    fprintf(stderr, "  <rom-list>       file with one ROM path per line, or - for stdin\n");
+    fprintf(stderr, "  -j <workers>     number of worker threads (default: one per core)\n");
+    fprintf(stderr, "  --cycles <n>     stop each ROM after n CPU cycles\n");
+    fprintf(stderr, "  --time-ms <n>    stop each ROM after n milliseconds\n");
+    fprintf(stderr, "  -o <summary>     write the JSON summary to a file instead of stdout\n");
+}
+
+int main(int argc, const char *argv[]) {
+    const char *program = argv[0];
+
+    Batch batch = {0};
+    const char *list_path = NULL;
+    const char *summary_path = NULL;
+    long worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; i++) {
+        const char *argument = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (strcmp(argument, "-j") == 0 && has_value) {
+            worker_count = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argument, "--cycles") == 0 && has_value) {
+            batch.cycle_budget = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argument, "--time-ms") == 0 && has_value) {
+            batch.time_budget = strtoull(argv[++i], NULL, 10) / 1000.0;
+        } else if (strcmp(argument, "-o") == 0 && has_value) {
+            summary_path = argv[++i];
+        } else if (list_path == NULL && (argument[0] != '-' || strcmp(argument, "-") == 0)) {
+            list_path = argument;
+        } else {
+            usage(program);
+            fprintf(stderr, "error: unexpected argument '%s'\n", argument);
+
+            return 1;
+        }
+    }
+
+    if (list_path == NULL) {
+        usage(program);
+        fprintf(stderr, "error: expected a ROM list\n");
+
+        return 1;
+    }
+
+    batch.rom_paths = read_rom_list(list_path, &batch.rom_count);
+
+    if (batch.rom_paths == NULL) {
+        return 1;
+    }
+
+    if (worker_count < 1) {
+        worker_count = 1;
+    }
+
+    if ((size_t)worker_count > batch.rom_count && batch.rom_count > 0) {
+        worker_count = batch.rom_count;
+    }
+
+    batch.worker_count = worker_count;
+    batch.results = calloc(batch.rom_count, sizeof(Result));
+    batch.workers = calloc(batch.worker_count, sizeof(Worker));
+
+    if ((batch.results == NULL && batch.rom_count > 0) || batch.workers == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+
+        return 1;
+    }
+
+    // Room for the emulator itself on top of the mapper state, so creating one never fails
+    size_t arena_size = ARENA_ALIGNMENT + sizeof(Emulator) + EMULATOR_ARENA_SIZE;
+
+    double start = now();
+
+    for (size_t i = 0; i < batch.worker_count; i++) {
+        Worker *worker = &batch.workers[i];
+
+        worker->batch = &batch;
+        worker->index = i;
+
+        void *memory = malloc(arena_size);
+
+        if (memory == NULL) {
+            fprintf(stderr, "error: out of memory for the arena of worker %zu\n", i);
+
+            return 1;
+        }
+
+        arena_init(&worker->arena, memory, arena_size);
+
+        pthread_mutex_init(&worker->queue.lock, NULL);
+        worker->queue.begin = batch.rom_count * i / batch.worker_count;
+        worker->queue.end = batch.rom_count * (i + 1) / batch.worker_count;
+    }
+
+    size_t started = 0;
+
+    while (started < batch.worker_count) {
+        int error = pthread_create(&batch.workers[started].thread, NULL, worker_main, &batch.workers[started]);
+
+        if (error != 0) {
+            fprintf(stderr, "warning: could not start worker %zu (%s), continuing with %zu\n", started,
+                    strerror(error), started + 1);
+            break;
+        }
+
+        started++;
+    }
+
+    // A worker that could not be started runs here instead, it steals what the others have not got to, so
+    // every ROM still runs
+    if (started < batch.worker_count) {
+        worker_main(&batch.workers[started]);
+    }
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(batch.workers[i].thread, NULL);
+    }
+
+    for (size_t i = 0; i < batch.worker_count; i++) {
+        free(batch.workers[i].arena.memory);
+    }
+
+    double seconds = now() - start;
+
+    FILE *summary = summary_path == NULL ? stdout : fopen(summary_path, "w");
+
+    if (summary == NULL) {
+        fprintf(stderr, "error: could not open file '%s': %s\n", summary_path, strerror(errno));
+
+        return 1;
+    }
+
+    write_summary(&batch, summary, seconds);
+
+    if (summary != stdout) {
+        fclose(summary);
+    }
+}
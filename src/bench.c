@@ -0,0 +1,416 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "emulator.h"
+#include "rewind.h"
+#include "tile.h"
+
+// NTSC CPU clock, the master clock of 21.477272 MHz divided by 12
+#define NTSC_CPU_HZ 1789773.0
+
+// The tile benchmark decodes this many background lines of 33 tile rows per pass
+#define BENCH_TILE_LINES 4096
+#define BENCH_TILE_PASSES 64
+
+// Save states saved and then loaded back at the end of every run
+#define BENCH_STATE_ROUNDS 1000
+
+// Frames pushed into a rewind history at the end of every run, 60 s of NTSC play. The budget is small enough
+// that the ring wraps around and drops the oldest frames, so that is checked too.
+#define BENCH_REWIND_FRAMES 3600
+#define BENCH_REWIND_BUDGET (256 * 1024)
+
+typedef struct {
+    double instructions_per_second;
+    double cycles_per_second;
+} BenchSample;
+
+typedef struct {
+    double push_seconds;
+    double step_back_seconds;
+    double bytes_per_frame;
+    double frames;
+} BenchRewind;
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double lhs = *(const double *)a;
+    double rhs = *(const double *)b;
+
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static void report(const char *name, double *values, int count, double scale, const char *unit) {
+    qsort(values, count, sizeof(double), compare_doubles);
+
+    double median = count % 2 == 1 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+
+    printf("%-16s min %10.3f%s  median %10.3f%s  max %10.3f%s\n", name, values[0] / scale, unit, median / scale,
+           unit, values[count - 1] / scale, unit);
+}
+
+// Runs the emulator until the master clock reaches the target, returns false if the ROM stopped before it
+static bool bench_step_until(Emulator *emulator, uint64_t master_clock) {
+    while (emulator->master_clock < master_clock) {
+        if (emulator_stopped(emulator)) {
+            return false;
+        }
+
+        uint64_t slice = master_clock - emulator->master_clock;
+
+        emulator_step(emulator, slice < 1024 ? slice : 1024);
+    }
+
+    return !emulator_stopped(emulator);
+}
+
+// Pushes every frame into a rewind history while keeping a copy of each state, then steps back through the
+// whole history and checks every state it restores against the copy byte for byte
+static bool bench_rewind(Emulator *emulator, BenchRewind *sample) {
+    Rewind rewind;
+
+    if (!rewind_init(&rewind, emulator, BENCH_REWIND_BUDGET)) {
+        fprintf(stderr, "error: a rewind budget of %d bytes does not hold this ROM's states\n",
+                BENCH_REWIND_BUDGET);
+
+        return false;
+    }
+
+    size_t state_size = emulator_state_size(emulator);
+    uint8_t *states = malloc(state_size * BENCH_REWIND_FRAMES);
+    uint8_t *restored = malloc(state_size);
+    bool ok = states != NULL && restored != NULL;
+
+    if (!ok) {
+        fprintf(stderr, "error: out of memory for %d save states\n", BENCH_REWIND_FRAMES);
+    }
+
+    double push_seconds = 0;
+    int pushed = 0;
+
+    while (ok && pushed < BENCH_REWIND_FRAMES) {
+        uint64_t frame = emulator->ppu.frame;
+
+        while (emulator->ppu.frame == frame && !emulator_stopped(emulator)) {
+            emulator_step(emulator, 1024);
+        }
+
+        if (emulator_stopped(emulator)) {
+            fprintf(stderr, "error: the ROM stopped after %d frames of rewind history\n", pushed);
+
+            ok = false;
+            break;
+        }
+
+        double start = now();
+
+        rewind_push(&rewind, emulator);
+
+        push_seconds += now() - start;
+
+        emulator_save_state(emulator, states + pushed * state_size, state_size);
+        pushed++;
+    }
+
+    int frames = ok ? rewind_frames(&rewind) : 0;
+    size_t delta_bytes = 0;
+
+    for (int i = 0; i < rewind.entries_count; i++) {
+        delta_bytes += rewind.entries[(rewind.entries_first + i) % rewind.entries_capacity].size;
+    }
+
+    double step_back_seconds = 0;
+
+    for (int back = 1; ok && back <= frames; back++) {
+        double start = now();
+
+        ok = rewind_step_back(&rewind, emulator);
+
+        step_back_seconds += now() - start;
+
+        emulator_save_state(emulator, restored, state_size);
+
+        if (!ok || memcmp(restored, states + (pushed - 1 - back) * state_size, state_size) != 0) {
+            fprintf(stderr, "error: stepping back %d frames did not restore the state saved then\n", back);
+
+            ok = false;
+        }
+    }
+
+    // The newest state is not a frame of history, so there is always one less frame than pushes
+    *sample = (BenchRewind){
+        .push_seconds = push_seconds / BENCH_REWIND_FRAMES,
+        .step_back_seconds = step_back_seconds / (frames > 0 ? frames : 1),
+        .bytes_per_frame = (double)delta_bytes / (frames > 0 ? frames : 1),
+        .frames = frames,
+    };
+
+    free(restored);
+    free(states);
+    rewind_free(&rewind);
+
+    return ok;
+}
+
+int bench_run(const char *rom_path, BenchOptions options) {
+    Emulator *emulator = calloc(1, sizeof(Emulator));
+
+    double *instructions_per_second = malloc(options.runs * sizeof(double));
+    double *cycles_per_second = malloc(options.runs * sizeof(double));
+    double *state_save_seconds = malloc(options.runs * sizeof(double));
+    double *state_load_seconds = malloc(options.runs * sizeof(double));
+    double *rewind_push_seconds = malloc(options.runs * sizeof(double));
+    double *rewind_step_back_seconds = malloc(options.runs * sizeof(double));
+    double *rewind_bytes_per_frame = malloc(options.runs * sizeof(double));
+    double *rewind_frames_kept = malloc(options.runs * sizeof(double));
+
+    int result = 0;
+
+    if (emulator == NULL || instructions_per_second == NULL || cycles_per_second == NULL ||
+        state_save_seconds == NULL || state_load_seconds == NULL || rewind_push_seconds == NULL ||
+        rewind_step_back_seconds == NULL || rewind_bytes_per_frame == NULL || rewind_frames_kept == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+
+        result = 1;
+    }
+
+    for (int run = 0; result == 0 && run < options.runs; run++) {
+        emulator_power_on(emulator);
+
+        if (!emulator_load_rom(emulator, rom_path)) {
+            fprintf(stderr, "error: %s\n", emulator_fault(emulator)->message);
+
+            result = 1;
+            break;
+        }
+
+        bench_step_until(emulator, options.warmup_cycles);
+
+        uint64_t start_cycles = emulator->cpu.cycles;
+        uint64_t start_instructions = emulator->cpu.instructions;
+        double start = now();
+
+        bool completed = bench_step_until(emulator, emulator->master_clock + options.cycles);
+
+        double seconds = now() - start;
+        uint64_t cycles = emulator->cpu.cycles - start_cycles;
+        uint64_t instructions = emulator->cpu.instructions - start_instructions;
+
+        if (!completed) {
+            const Fault *fault = emulator_fault(emulator);
+
+            if (fault->kind != FAULT_NONE) {
+                fprintf(stderr, "error: %s\n", fault->message);
+            } else {
+                fprintf(stderr, "error: the ROM stopped after %llu cycles, the measurement needs %llu\n",
+                        (unsigned long long)emulator->cpu.cycles,
+                        (unsigned long long)(options.warmup_cycles + options.cycles));
+            }
+
+            emulator_unload_rom(emulator);
+
+            result = 1;
+            break;
+        }
+
+        size_t state_size = emulator_state_size(emulator);
+        uint8_t *state = malloc(state_size);
+
+        if (state == NULL) {
+            fprintf(stderr, "error: out of memory\n");
+
+            emulator_unload_rom(emulator);
+
+            result = 1;
+            break;
+        }
+
+        start = now();
+
+        for (int i = 0; i < BENCH_STATE_ROUNDS; i++) {
+            emulator_save_state(emulator, state, state_size);
+        }
+
+        state_save_seconds[run] = (now() - start) / BENCH_STATE_ROUNDS;
+        start = now();
+
+        for (int i = 0; i < BENCH_STATE_ROUNDS; i++) {
+            emulator_load_state(emulator, state, state_size);
+        }
+
+        state_load_seconds[run] = (now() - start) / BENCH_STATE_ROUNDS;
+
+        free(state);
+
+        BenchRewind rewind;
+
+        if (!bench_rewind(emulator, &rewind)) {
+            emulator_unload_rom(emulator);
+
+            result = 1;
+            break;
+        }
+
+        rewind_push_seconds[run] = rewind.push_seconds;
+        rewind_step_back_seconds[run] = rewind.step_back_seconds;
+        rewind_bytes_per_frame[run] = rewind.bytes_per_frame;
+        rewind_frames_kept[run] = rewind.frames;
+
+        emulator_unload_rom(emulator);
+
+        instructions_per_second[run] = instructions / seconds;
+        cycles_per_second[run] = cycles / seconds;
+    }
+
+    if (result == 0) {
+        printf("%d runs of %llu cycles (%.3f s of NTSC time) after %llu warmup cycles\n", options.runs,
+               (unsigned long long)options.cycles, options.cycles / NTSC_CPU_HZ,
+               (unsigned long long)options.warmup_cycles);
+
+        report("instructions/s", instructions_per_second, options.runs, 1e6, "M");
+        report("cycles/s", cycles_per_second, options.runs, 1e6, "M");
+        report("vs real time", cycles_per_second, options.runs, NTSC_CPU_HZ, "x");
+        report("state save", state_save_seconds, options.runs, 1e-6, "us");
+        report("state load", state_load_seconds, options.runs, 1e-6, "us");
+        report("rewind push", rewind_push_seconds, options.runs, 1e-6, "us");
+        report("rewind back", rewind_step_back_seconds, options.runs, 1e-6, "us");
+        report("rewind B/frame", rewind_bytes_per_frame, options.runs, 1, "B");
+        report("rewind frames", rewind_frames_kept, options.runs, 1, "");
+    }
+
+    free(rewind_frames_kept);
+    free(rewind_bytes_per_frame);
+    free(rewind_step_back_seconds);
+    free(rewind_push_seconds);
+    free(state_load_seconds);
+    free(state_save_seconds);
+    free(cycles_per_second);
+    free(instructions_per_second);
+
+    if (emulator != NULL) {
+        emulator_destroy(emulator);
+        free(emulator);
+    }
+
+    return result;
+}
+
+typedef struct {
+    const char *name;
+    TileRowDecoder decode;
+} BenchDecoder;
+
+static double bench_decoder(TileRowDecoder decode, const uint8_t *low, const uint8_t *high,
+                            const uint8_t *palettes, uint8_t *pixels) {
+    double start = now();
+
+    for (int pass = 0; pass < BENCH_TILE_PASSES; pass++) {
+        for (int line = 0; line < BENCH_TILE_LINES; line++) {
+            decode(low + line * 33, high + line * 33, palettes + line * 33, 33, pixels + line * 33 * 8);
+        }
+    }
+
+    return (double)BENCH_TILE_PASSES * BENCH_TILE_LINES * 33 * 8 / (now() - start);
+}
+
+int bench_tiles(int runs) {
+    BenchDecoder decoders[3];
+    int decoder_count = 0;
+
+    decoders[decoder_count++] = (BenchDecoder){"scalar", tile_decode_rows_scalar};
+#ifdef TILE_X86
+    decoders[decoder_count++] = (BenchDecoder){"sse2", tile_decode_rows_sse2};
+
+    if (tile_avx2_supported()) {
+        decoders[decoder_count++] = (BenchDecoder){"avx2", tile_decode_rows_avx2};
+    }
+#endif
+
+    size_t tiles = BENCH_TILE_LINES * 33;
+
+    uint8_t *low = malloc(tiles);
+    uint8_t *high = malloc(tiles);
+    uint8_t *palettes = malloc(tiles);
+    uint8_t *expected = malloc(tiles * 8);
+    uint8_t *pixels = malloc(tiles * 8);
+    double *samples = malloc(runs * sizeof(double));
+
+    if (low == NULL || high == NULL || palettes == NULL || expected == NULL || pixels == NULL || samples == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+
+        free(samples);
+        free(pixels);
+        free(expected);
+        free(palettes);
+        free(high);
+        free(low);
+
+        return 1;
+    }
+
+    // xorshift, so every run sees the same tiles
+    uint32_t state = 0x2c02;
+
+    for (size_t i = 0; i < tiles; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+
+        low[i] = state;
+        high[i] = state >> 8;
+        palettes[i] = (state >> 16) & 0x0c;
+    }
+
+    tile_decode_rows_scalar(low, high, palettes, tiles, expected);
+
+    int result = 0;
+    double scalar_median = 0;
+
+    printf("%d runs decoding %d tile rows\n", runs, BENCH_TILE_PASSES * BENCH_TILE_LINES * 33);
+
+    for (int i = 0; i < decoder_count; i++) {
+        memset(pixels, 0, tiles * 8);
+        decoders[i].decode(low, high, palettes, tiles, pixels);
+
+        if (memcmp(pixels, expected, tiles * 8) != 0) {
+            fprintf(stderr, "error: the %s decoder disagrees with the scalar one\n", decoders[i].name);
+
+            result = 1;
+            break;
+        }
+
+        for (int run = 0; run < runs; run++) {
+            samples[run] = bench_decoder(decoders[i].decode, low, high, palettes, pixels);
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "%s pixels/s", decoders[i].name);
+        report(name, samples, runs, 1e6, "M");
+
+        double median = samples[runs / 2];
+
+        if (i == 0) {
+            scalar_median = median;
+        } else {
+            printf("%-16s %.2fx the scalar decoder\n", "", median / scalar_median);
+        }
+    }
+
+    free(samples);
+    free(pixels);
+    free(expected);
+    free(palettes);
+    free(high);
+    free(low);
+
+    return result;
+}
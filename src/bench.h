@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+    // Emulated CPU cycles run before the measurement starts, to warm up caches and branch predictors
+    uint64_t warmup_cycles;
+    // Emulated CPU cycles measured per run
+    uint64_t cycles;
+    int runs;
+} BenchOptions;
+
+int bench_run(const char *rom_path, BenchOptions);
+
+// Measures the tile row decoders against the scalar one on random tiles, after checking they agree with it
+int bench_tiles(int runs);
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Every component counts time in CPU cycles on a monotonic 64-bit clock. Points on it are compared through
+// their signed distance so catching up only ever depends on the delta between two clocks.
+static inline bool clock_is_before(uint64_t clock, uint64_t deadline) { return (int64_t)(clock - deadline) < 0; }
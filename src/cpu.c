@@ -1,13 +1,17 @@
 #include <errno.h>
 #include <malloc.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "clock.h"
 #include "cpu.h"
-#include "exit.h"
+#include "disassembler.h"
 #include "fs.h"
+#include "ines.h"
 #include "mapper.h"
 
 static void cpu_status_set_carry(Cpu *cpu) { cpu->status |= 1; }
@@ -46,137 +50,291 @@ bool cpu_stopped(Cpu *cpu) { return (cpu->status & (1 << 4)) != 0; }
 static void cpu_stop(Cpu *cpu) { cpu->status |= (1 << 4); }
 static void cpu_start(Cpu *cpu) { cpu->status &= ~(1 << 4); }
 
+// Records the fault and stops the CPU so the emulator can report it instead of taking the process down
+static void cpu_fault(Cpu *cpu, FaultKind kind, const char *format, ...) {
+    cpu->fault.kind = kind;
+    cpu->fault.instruction_pointer = cpu->instruction_pointer;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(cpu->fault.message, sizeof(cpu->fault.message), format, args);
+    va_end(args);
+
+    cpu_stop(cpu);
+}
+
 void cpu_power_on(Cpu *cpu) {
     cpu->stack_pointer = 0xFD;
     cpu->status = 0x34;
+    cpu->cycles = 0;
+    cpu->instructions = 0;
+    cpu->irq = false;
+    cpu->fault = (Fault){0};
+
+#ifdef LOYD_PROFILE
+    memset(&cpu->profile, 0, sizeof(CpuProfile));
+#endif
     cpu->instruction_pointer = cpu->accumulator = cpu->register_x = cpu->register_y = 0;
 }
 
-void cpu_load_rom(Cpu *cpu, const char *path) {
-    FILE *file = fopen(path, "rb");
+static uint8_t cpu_read_io_register(Cpu *cpu, uint16_t pointer) {
+    if (cpu->bus.read == NULL) {
+        return 0;
+    }
 
-    if (file == NULL) {
-        fprintf(stderr, "error: could not open file '%s': %s\n", path, strerror(errno));
+    return cpu->bus.read(cpu->bus.context, pointer);
+}
 
-        exit(1);
+static void cpu_write_io_register(Cpu *cpu, uint16_t pointer, uint8_t byte) {
+    if (cpu->bus.write != NULL) {
+        cpu->bus.write(cpu->bus.context, pointer, byte);
     }
+}
 
-    uint8_t magic[4];
-    read_bytes_into(magic, file, path, 4);
+// Page $40 holds the APU and I/O registers in its first 32 bytes, nothing answers in the rest of it
+static uint8_t cpu_read_io_page(Cpu *cpu, uint16_t pointer) {
+    if (pointer < 0x4020) {
+        return cpu_read_io_register(cpu, pointer);
+    }
 
-    uint8_t expected_magic[4] = {'N', 'E', 'S', 0x1a};
+    return 0;
+}
+
+static void cpu_write_io_page(Cpu *cpu, uint16_t pointer, uint8_t byte) {
+    if (pointer < 0x4020) {
+        cpu_write_io_register(cpu, pointer, byte);
+    }
+}
+
+static uint8_t cpu_read_open_bus(Cpu *cpu, uint16_t pointer) {
+    (void)cpu;
+    (void)pointer;
 
-    if (memcmp(magic, expected_magic, 4) != 0) {
-        fprintf(stderr, "error: invalid magic: expected '%d', got '%d'\n", *(uint32_t *)expected_magic,
-                *(uint32_t *)magic);
+    return 0;
+}
 
-        fclose(file);
+static void cpu_write_rom(Cpu *cpu, uint16_t pointer, uint8_t byte) {
+    (void)cpu;
+    (void)pointer;
+    (void)byte;
+}
 
-        exit(1);
+static void cpu_invalidate_mapper(Cpu *cpu);
+
+static void cpu_write_mapper_register(Cpu *cpu, uint16_t pointer, uint8_t byte) {
+    if (pointer >= cpu->mapper_description.registers_start && pointer < cpu->mapper_description.registers_end) {
+        bool counts_scanlines = cpu->mapper.clock_scanlines != NULL && cpu->bus.mapper_sync != NULL;
+
+        if (counts_scanlines) {
+            cpu->bus.mapper_sync(cpu->bus.context);
+        }
+
+        if (cpu->mapper.register_write(cpu->mapper.context, pointer, byte)) {
+            cpu_invalidate_mapper(cpu);
+        }
+
+        if (counts_scanlines) {
+            cpu->bus.mapper_written(cpu->bus.context);
+        }
     }
+}
 
-    uint32_t prg_rom_size = read_byte(file, path);
-    uint32_t chr_rom_size = read_byte(file, path);
+// Rebuilds the page table, which has to happen every time the mapper changes what is visible to the CPU
+static void cpu_map_pages(Cpu *cpu) {
+    for (int i = 0; i < CPU_PAGE_COUNT; i++) {
+        CpuPage *page = &cpu->pages[i];
+
+        if (i < 0x20) {
+            // 2 KiB of internal RAM mirrored up to $2000
+            page->read_memory = page->write_memory = cpu->ram + ((i & 0x07) << 8);
+        } else if (i < 0x40) {
+            // PPU registers mirrored up to $4000
+            page->read_memory = page->write_memory = NULL;
+            page->read = cpu_read_io_register;
+            page->write = cpu_write_io_register;
+        } else if (i == 0x40) {
+            page->read_memory = page->write_memory = NULL;
+            page->read = cpu_read_io_page;
+            page->write = cpu_write_io_page;
+        } else if (i < 0x60) {
+            // Expansion area, unused by the supported cartridges
+            page->read_memory = page->write_memory = NULL;
+            page->read = cpu_read_open_bus;
+            page->write = cpu_write_rom;
+        } else {
+            // PRG RAM and ROM, straight from the mapper's memory
+            MapperBank bank = cpu->mapper.prg_page(cpu->mapper.context, i);
 
-    prg_rom_size *= 16 * 1024;
-    chr_rom_size *= 8 * 1024;
+            page->read_memory = bank.read;
+            page->write_memory = bank.write;
+            page->read = cpu_read_open_bus;
+            page->write = cpu_write_rom;
+        }
+    }
 
-    uint8_t flag6 = read_byte(file, path);
-    uint8_t flag7 = read_byte(file, path);
+    if (cpu->mapper.register_write != NULL) {
+        for (int i = cpu->mapper_description.registers_start >> 8;
+             i < CPU_PAGE_COUNT && (uint32_t)(i << 8) < cpu->mapper_description.registers_end; i++) {
+            cpu->pages[i].write_memory = NULL;
+            cpu->pages[i].write = cpu_write_mapper_register;
+        }
+    }
+}
 
-    // PRG RAM size in 8 KiB
-    read_byte(file, path);
+static void cpu_invalidate_mapper(Cpu *cpu) {
+    cpu->mapper_description = cpu->mapper.description(cpu->mapper.context);
 
-    // flag8
-    read_byte(file, path);
+    cpu_map_pages(cpu);
 
-    // flag9
-    read_byte(file, path);
+    if (cpu->bus.mapper_invalidated != NULL) {
+        cpu->bus.mapper_invalidated(cpu->bus.context);
+    }
+}
+
+static void cpu_reset(Cpu *cpu);
+
+bool cpu_load_rom(Cpu *cpu, Arena *arena, const char *path) {
+    size_t mark = arena_mark(arena);
+    FileContents rom;
 
-    uint8_t reserved[5];
-    read_bytes_into(reserved, file, path, 5);
+    if (!map_file(path, arena, &rom)) {
+        cpu_fault(cpu, errno == ENOMEM ? FAULT_OUT_OF_MEMORY : FAULT_IO, "could not read file '%s': %s", path,
+                  strerror(errno));
 
-    if (flag7 == 0x44) {
-        flag7 = 0;
+        return false;
     }
 
-    uint8_t mapper_id_lsb = (flag6 >> 4);
-    uint8_t mapper_id_hsb = (flag7 >> 4);
-    uint8_t mapper_id = (mapper_id_hsb << 4) | mapper_id_lsb;
+    FileCursor cursor = {.contents = rom};
+    const uint8_t *header = file_take(&cursor, INES_HEADER_SIZE);
+
+    if (header == NULL) {
+        cpu_fault(cpu, FAULT_BAD_HEADER, "file '%s' is smaller than expected: was trying to read %d bytes",
+                  path, INES_HEADER_SIZE);
+
+        unmap_file(&rom);
+        arena_rewind(arena, mark);
 
-    if (flag6 & (1 << 2)) {
-        uint8_t trainer[512];
-        read_bytes_into(trainer, file, path, 512);
+        return false;
     }
 
-    uint8_t *prg_rom = read_bytes(file, path, prg_rom_size);
-    uint8_t *chr_rom = read_bytes(file, path, chr_rom_size);
+    uint8_t expected_magic[4] = {'N', 'E', 'S', 0x1a};
 
-    switch (mapper_id) {
-    case 0:
-        cpu->mapper = nrom_mapper(prg_rom, prg_rom_size, chr_rom, chr_rom_size);
-        break;
+    if (memcmp(header, expected_magic, 4) != 0) {
+        cpu_fault(cpu, FAULT_BAD_HEADER, "invalid magic: expected '%d', got '%d'", *(uint32_t *)expected_magic,
+                  *(uint32_t *)header);
 
-    default:
-        printf("error: unsupported mapper: %d\n", mapper_id);
-        exit(1);
+        unmap_file(&rom);
+        arena_rewind(arena, mark);
+
+        return false;
     }
 
-    memset(cpu->ram, 0, RAM_SIZE);
+    InesHeader ines;
 
-    cpu->mapper.map_ram(cpu->mapper.context, cpu->ram);
+    ines_parse_header(header, &ines);
 
-    cpu->instruction_pointer = cpu->mapper.description(cpu->mapper.context).instruction_pointer;
+    // The banks point straight into the file, the trainer is skipped. NES 2.0 exponent sizes can be anything
+    // up to UINT64_MAX, the cursor turns those down like any other short file.
+    file_take(&cursor, ines.trainer ? INES_TRAINER_SIZE : 0);
+    const uint8_t *prg_rom = file_take(&cursor, ines.prg_rom_size);
+    const uint8_t *chr_rom = file_take(&cursor, ines.chr_rom_size);
 
-    cpu_start(cpu);
-}
+    if (cursor.failed) {
+        cpu_fault(cpu, FAULT_BAD_HEADER, "file '%s' is smaller than its header says: %zu bytes", path,
+                  rom.size);
+
+        unmap_file(&rom);
+        arena_rewind(arena, mark);
 
-static inline void mirror_pointer(uint16_t *pointer) {
-    if ((*pointer & 0xE000) == 0) {
-        *pointer &= 0x7ff;
-    } else if ((*pointer & 0xE000) == 0x2000) {
-        *pointer &= 0x2007;
+        return false;
     }
-}
 
-static inline bool is_io_register(uint16_t pointer) {
-    if ((pointer & 0xfff8) == 0x2000) {
-        return true;
-    } else if ((pointer & 0xffe0) == 0x4000) {
-        return true;
-    } else {
+    // Carts without CHR ROM have CHR RAM instead, every cart has PRG ROM
+    if (ines.prg_rom_size == 0 || ines.prg_rom_size % INES_PRG_BANK_SIZE != 0 ||
+        ines.chr_rom_size % INES_CHR_BANK_SIZE != 0) {
+        cpu_fault(cpu, FAULT_BAD_HEADER, "file '%s' is not whole banks: %llu bytes of PRG ROM, %llu of CHR",
+                  path, (unsigned long long)ines.prg_rom_size, (unsigned long long)ines.chr_rom_size);
+
+        unmap_file(&rom);
+        arena_rewind(arena, mark);
+
         return false;
     }
-}
 
-static inline void cpu_write_byte(Cpu *cpu, uint16_t pointer, uint8_t byte) {
-    mirror_pointer(&pointer);
+    const MapperEntry *entry = mapper_find(ines.mapper);
 
-    if (is_io_register(pointer)) {
-        return;
+    if (entry == NULL) {
+        cpu_fault(cpu, FAULT_UNSUPPORTED_MAPPER, "unsupported mapper: %d", ines.mapper);
+
+        unmap_file(&rom);
+        arena_rewind(arena, mark);
+
+        return false;
     }
 
-    if (cpu->mapper.register_write != NULL) {
-        MapperDesription mapper_description = cpu->mapper.description(cpu->mapper.context);
+    MapperCart cart = {
+        .prg_rom = prg_rom,
+        .prg_rom_size = ines.prg_rom_size,
+        .chr_rom = chr_rom,
+        .chr_rom_size = ines.chr_rom_size,
+        .prg_ram_size = ines.prg_ram_size + ines.prg_nvram_size,
+        .chr_ram_size = ines.chr_ram_size + ines.chr_nvram_size,
+        .mirroring = ines.mirroring,
+        .submapper = ines.submapper,
+    };
 
-        if (mapper_description.registers_start >= pointer && pointer < mapper_description.registers_end) {
-            cpu->mapper.register_write(cpu->mapper.context, pointer, byte);
+    cpu->mapper = entry->create(arena, &cart);
 
-            return;
-        }
+    if (cpu->mapper.context == NULL) {
+        cpu_fault(cpu, FAULT_OUT_OF_MEMORY, "not enough memory left for %s of '%s'", entry->name, path);
+
+        unmap_file(&rom);
+        arena_rewind(arena, mark);
+
+        return false;
     }
 
-    cpu->ram[pointer] = byte;
+    cpu->rom = rom;
+    cpu->ines = ines;
+
+    memset(cpu->ram, 0, CPU_RAM_SIZE);
+
+    cpu_invalidate_mapper(cpu);
+
+    cpu_reset(cpu);
+
+    cpu_start(cpu);
+
+    return true;
 }
 
-static inline uint8_t cpu_read_byte(Cpu *cpu, uint16_t pointer) {
-    mirror_pointer(&pointer);
+void cpu_unload_rom(Cpu *cpu) {
+    // The mapper lives in the arena the ROM was loaded into, whoever owns it reclaims it. So does the file
+    // when it was read rather than mapped.
+    cpu->mapper = (Mapper){0};
+    unmap_file(&cpu->rom);
 
-    if (is_io_register(pointer)) {
-        return 0;
+    cpu_stop(cpu);
+}
+
+static inline void cpu_write_byte(Cpu *cpu, uint16_t pointer, uint8_t byte) {
+    CpuPage *page = &cpu->pages[pointer >> 8];
+
+    if (page->write_memory != NULL) {
+        page->write_memory[pointer & 0xff] = byte;
+    } else {
+        page->write(cpu, pointer, byte);
     }
+}
+
+static inline uint8_t cpu_read_byte(Cpu *cpu, uint16_t pointer) {
+    CpuPage *page = &cpu->pages[pointer >> 8];
 
-    return cpu->ram[pointer];
+    if (page->read_memory != NULL) {
+        return page->read_memory[pointer & 0xff];
+    } else {
+        return page->read(cpu, pointer);
+    }
 }
 
 static inline uint16_t cpu_read_word(Cpu *cpu, uint16_t pointer) {
@@ -194,25 +352,43 @@ static inline uint16_t cpu_decode_word(Cpu *cpu) {
     return word;
 }
 
-static uint16_t cpu_decode_operand_pointer(Cpu *cpu, AddressingMode addressing_mode) {
+static inline bool is_page_crossed(uint16_t from, uint16_t to) { return (from & 0xff00) != (to & 0xff00); }
+
+static inline uint16_t cpu_decode_indexed_pointer(Cpu *cpu, uint16_t base, uint8_t index) {
+    uint16_t pointer = base + index;
+    cpu->page_crossed = is_page_crossed(base, pointer);
+    return pointer;
+}
+
+// Pointers stored in the zero page wrap around within it
+static inline uint16_t cpu_read_zero_page_word(Cpu *cpu, uint8_t pointer) {
+    uint16_t lsb = cpu_read_byte(cpu, pointer);
+    uint16_t hsb = cpu_read_byte(cpu, (uint8_t)(pointer + 1));
+
+    return (hsb << 8) | lsb;
+}
+
+static inline uint16_t cpu_decode_operand_pointer(Cpu *cpu, AddressingMode addressing_mode) {
     switch (addressing_mode) {
+    case AM_IMPLICIT:
+        break;
     case AM_ACCUMULATOR:
-        return cpu->accumulator;
+        break;
     case AM_RELATIVE:
     case AM_IMMEDIATE:
         return cpu->instruction_pointer++;
     case AM_ABSOLUTE:
         return cpu_decode_word(cpu);
     case AM_ABSOLUTE_X:
-        return cpu_decode_word(cpu) + cpu->register_x;
+        return cpu_decode_indexed_pointer(cpu, cpu_decode_word(cpu), cpu->register_x);
     case AM_ABSOLUTE_Y:
-        return cpu_decode_word(cpu) + cpu->register_y;
+        return cpu_decode_indexed_pointer(cpu, cpu_decode_word(cpu), cpu->register_y);
     case AM_ZERO_PAGE:
         return cpu_decode_byte(cpu);
     case AM_ZERO_PAGE_X:
-        return cpu_decode_byte(cpu) + cpu->register_x;
+        return (uint8_t)(cpu_decode_byte(cpu) + cpu->register_x);
     case AM_ZERO_PAGE_Y:
-        return cpu_decode_byte(cpu) + cpu->register_y;
+        return (uint8_t)(cpu_decode_byte(cpu) + cpu->register_y);
     case AM_INDIRECT_JMP: {
         uint16_t pointer = cpu_decode_word(cpu);
 
@@ -225,69 +401,117 @@ static uint16_t cpu_decode_operand_pointer(Cpu *cpu, AddressingMode addressing_m
         }
     }
     case AM_INDIRECT_X:
-        return cpu_read_word(cpu, cpu_decode_byte(cpu) + cpu->register_x);
+        return cpu_read_zero_page_word(cpu, cpu_decode_byte(cpu) + cpu->register_x);
     case AM_INDIRECT_Y:
-        return cpu_read_word(cpu, cpu_decode_byte(cpu)) + cpu->register_y;
+        return cpu_decode_indexed_pointer(cpu, cpu_read_zero_page_word(cpu, cpu_decode_byte(cpu)),
+                                          cpu->register_y);
+    }
 
-    default:
-        printf("error: unknown addressing mode: %d\n", addressing_mode);
-        exit(1);
+    // Implicit and accumulator instructions have no operand in memory
+    return 0;
+}
 
-        break;
+// Read-modify-write instructions work on the accumulator instead of memory in accumulator mode
+static inline uint8_t cpu_read_modified(Cpu *cpu, AddressingMode addressing_mode, uint16_t pointer) {
+    return addressing_mode == AM_ACCUMULATOR ? cpu->accumulator : cpu_read_byte(cpu, pointer);
+}
+
+static inline void cpu_write_modified(Cpu *cpu, AddressingMode addressing_mode, uint16_t pointer, uint8_t byte) {
+    if (addressing_mode == AM_ACCUMULATOR) {
+        cpu->accumulator = byte;
+    } else {
+        cpu_write_byte(cpu, pointer, byte);
     }
 }
 
 static inline uint8_t cpu_decode_operand(Cpu *cpu, AddressingMode addressing_mode) {
-    return cpu_read_byte(cpu, cpu_decode_operand_pointer(cpu, addressing_mode));
+    uint16_t pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
+
+    // Indexed reads spend an extra cycle fixing up the high byte of the pointer when they cross a page,
+    // stores and read-modify-write instructions always pay for it in their base cycles
+    if (addressing_mode == AM_ABSOLUTE_X || addressing_mode == AM_ABSOLUTE_Y ||
+        addressing_mode == AM_INDIRECT_Y) {
+        cpu->cycles += cpu->page_crossed;
+    }
+
+    return cpu_read_byte(cpu, pointer);
 }
 
 static inline void cpu_push_byte(Cpu *cpu, uint8_t byte) { cpu_write_byte(cpu, cpu->stack_pointer--, byte); }
 
 static inline uint8_t cpu_pull_byte(Cpu *cpu) { return cpu_read_byte(cpu, ++cpu->stack_pointer); }
 
+// Words go on the stack high byte first, so they sit in memory little endian
 static inline void cpu_push_word(Cpu *cpu, uint16_t word) {
     uint8_t lsb = word;
     uint8_t hsb = word >> 8;
-    cpu_push_byte(cpu, lsb);
     cpu_push_byte(cpu, hsb);
+    cpu_push_byte(cpu, lsb);
 }
 
 static inline uint16_t cpu_pull_word(Cpu *cpu) {
-    uint8_t hsb = cpu_pull_byte(cpu);
     uint8_t lsb = cpu_pull_byte(cpu);
+    uint8_t hsb = cpu_pull_byte(cpu);
     return (hsb << 8) | lsb;
 }
 
-static void adc(Cpu *cpu, uint8_t rhs) {
-    uint8_t lhs = cpu->accumulator;
+uint8_t cpu_read(Cpu *cpu, uint16_t pointer) { return cpu_read_byte(cpu, pointer); }
 
-    rhs += lhs;
+static void cpu_reset(Cpu *cpu) { cpu->instruction_pointer = cpu_read_word(cpu, 0xfffc); }
 
-    bool carry = rhs < lhs;
+static void cpu_interrupt(Cpu *cpu, uint16_t vector) {
+    // Interrupts push the status with the break flag clear, which is where the stopped bit lives
+    cpu_push_word(cpu, cpu->instruction_pointer);
+    cpu_push_byte(cpu, (cpu->status & 0xef) | 0x20);
+    cpu_status_disable_interrupts(cpu);
 
-    uint8_t old_lhs = lhs;
+    cpu->instruction_pointer = cpu_read_word(cpu, vector);
+    cpu->cycles += 7;
+}
 
-    lhs = rhs;
+void cpu_nmi(Cpu *cpu) {
+    if (cpu_stopped(cpu)) {
+        return;
+    }
 
-    rhs += cpu_status_is_carry(cpu);
+    cpu_interrupt(cpu, 0xfffa);
+}
 
-    carry = carry || rhs < lhs;
+void cpu_irq(Cpu *cpu) {
+    if (cpu_stopped(cpu) || (cpu->status & (1 << 2))) {
+        return;
+    }
+
+    cpu_interrupt(cpu, 0xfffe);
+}
+
+// An IRQ held off by the interrupt disable flag is taken as soon as an instruction clears it
+static void cpu_interrupts_enabled(Cpu *cpu) {
+    if (cpu->irq && !(cpu->status & (1 << 2))) {
+        cpu_yield(cpu);
+    }
+}
+
+static void adc(Cpu *cpu, uint8_t rhs) {
+    uint8_t lhs = cpu->accumulator;
+    uint16_t sum = lhs + rhs + cpu_status_is_carry(cpu);
+    uint8_t result = sum;
 
     // Check for carry bit
-    if (carry) {
+    if (sum > 0xff) {
         cpu_status_set_carry(cpu);
     } else {
         cpu_status_clear_carry(cpu);
     }
 
-    // Check for sign overflow
-    if ((((old_lhs & (1 << 7)) == (lhs & (1 << 7))) && ((old_lhs & (1 << 7)) != (rhs & (1 << 7))))) {
+    // Check for sign overflow, which happens when both operands have the same sign and the result does not
+    if (~(lhs ^ rhs) & (lhs ^ result) & (1 << 7)) {
         cpu_status_set_overflow(cpu);
     } else {
         cpu_status_clear_overflow(cpu);
     }
 
-    cpu->accumulator = rhs;
+    cpu->accumulator = result;
 
     cpu_status_update_zero_and_negative(cpu, cpu->accumulator);
 }
@@ -297,7 +521,12 @@ static void branch(Cpu *cpu, bool condition) {
     int8_t relative = *(int8_t *)&operand;
 
     if (condition) {
-        cpu->instruction_pointer += relative;
+        uint16_t target = cpu->instruction_pointer + relative;
+
+        // A taken branch costs one more cycle, and another one if it lands on a different page
+        cpu->cycles += 1 + is_page_crossed(cpu->instruction_pointer, target);
+
+        cpu->instruction_pointer = target;
     }
 }
 
@@ -331,42 +560,58 @@ static void cpu_execute_php(Cpu *cpu) { cpu_push_byte(cpu, cpu->status | 0x30);
 // Pull processor status
 static void cpu_execute_plp(Cpu *cpu) {
     cpu->status = (cpu_pull_byte(cpu) & 0xef) | (cpu->status & 0x10) | 0x20;
+    cpu_interrupts_enabled(cpu);
 }
 
 // Push accumulator
 static void cpu_execute_pha(Cpu *cpu) { cpu_push_byte(cpu, cpu->accumulator); }
 
 // Pull accumulator
-static void cpu_execute_pla(Cpu *cpu) { cpu->accumulator = cpu_pull_word(cpu); }
+static void cpu_execute_pla(Cpu *cpu) {
+    cpu_status_update_zero_and_negative(cpu, cpu->accumulator = cpu_pull_byte(cpu));
+}
 
-// Jump to subroutine
+// Jump to subroutine, pushing the address of its own last byte
 static void cpu_execute_jsr(Cpu *cpu) {
+    uint16_t target = cpu_decode_word(cpu);
     cpu_push_word(cpu, cpu->instruction_pointer - 1);
-    cpu->instruction_pointer = cpu_decode_word(cpu);
+    cpu->instruction_pointer = target;
 }
 
 // Return from subroutine
 static void cpu_execute_rts(Cpu *cpu) { cpu->instruction_pointer = cpu_pull_word(cpu) + 1; }
 
+// Clear interrupt disable
+static void cpu_execute_cli(Cpu *cpu) {
+    cpu_status_enable_interrupts(cpu);
+    cpu_interrupts_enabled(cpu);
+}
+
+// Return from interrupt
+static void cpu_execute_rti(Cpu *cpu) {
+    cpu_execute_plp(cpu);
+    cpu->instruction_pointer = cpu_pull_word(cpu);
+}
+
 // Add with carry
-static void cpu_execute_adc(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_adc(Cpu *cpu, AddressingMode addressing_mode) {
     adc(cpu, cpu_decode_operand(cpu, addressing_mode));
 }
 
 // Subtract with carry
-static void cpu_execute_sbc(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_sbc(Cpu *cpu, AddressingMode addressing_mode) {
     adc(cpu, ~cpu_decode_operand(cpu, addressing_mode));
 }
 
 // Rotate left
-static void cpu_execute_rol(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_rol(Cpu *cpu, AddressingMode addressing_mode) {
     uint16_t pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
 
-    uint8_t old_value = cpu_read_byte(cpu, pointer);
+    uint8_t old_value = cpu_read_modified(cpu, addressing_mode, pointer);
 
     uint8_t new_value = (old_value << 1) | (uint8_t)cpu_status_is_carry(cpu);
 
-    cpu_write_byte(cpu, pointer, new_value);
+    cpu_write_modified(cpu, addressing_mode, pointer, new_value);
 
     if (old_value & (1 << 7)) {
         cpu_status_set_carry(cpu);
@@ -378,14 +623,14 @@ static void cpu_execute_rol(Cpu *cpu, AddressingMode addressing_mode) {
 }
 
 // Rotate right
-static void cpu_execute_ror(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_ror(Cpu *cpu, AddressingMode addressing_mode) {
     uint16_t pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
 
-    uint8_t old_value = cpu_read_byte(cpu, pointer);
+    uint8_t old_value = cpu_read_modified(cpu, addressing_mode, pointer);
 
     uint8_t new_value = (old_value >> 1) | ((uint8_t)cpu_status_is_carry(cpu) << 7);
 
-    cpu_write_byte(cpu, pointer, new_value);
+    cpu_write_modified(cpu, addressing_mode, pointer, new_value);
 
     if (old_value & 1) {
         cpu_status_set_carry(cpu);
@@ -397,7 +642,7 @@ static void cpu_execute_ror(Cpu *cpu, AddressingMode addressing_mode) {
 }
 
 // Rotate left then perform Logical And on the value
-static void cpu_execute_rla(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_rla(Cpu *cpu, AddressingMode addressing_mode) {
     uint16_t pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
 
     uint8_t old_value = cpu_read_byte(cpu, pointer);
@@ -415,17 +660,17 @@ static void cpu_execute_rla(Cpu *cpu, AddressingMode addressing_mode) {
     cpu_status_update_zero_and_negative(cpu, cpu->accumulator &= new_value);
 }
 
-// Rotate left then perform Add with Carry on the value
-static void cpu_execute_rra(Cpu *cpu, AddressingMode addressing_mode) {
+// Rotate right then perform Add with Carry on the value
+static inline void cpu_execute_rra(Cpu *cpu, AddressingMode addressing_mode) {
     uint16_t pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
 
     uint8_t old_value = cpu_read_byte(cpu, pointer);
 
-    uint8_t new_value = (old_value << 1) | (uint8_t)cpu_status_is_carry(cpu);
+    uint8_t new_value = (old_value >> 1) | ((uint8_t)cpu_status_is_carry(cpu) << 7);
 
     cpu_write_byte(cpu, pointer, new_value);
 
-    if (old_value & (1 << 7)) {
+    if (old_value & 1) {
         cpu_status_set_carry(cpu);
     } else {
         cpu_status_clear_carry(cpu);
@@ -435,28 +680,28 @@ static void cpu_execute_rra(Cpu *cpu, AddressingMode addressing_mode) {
 }
 
 // Logical And with accumulator and register X
-static void cpu_execute_sax(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_sax(Cpu *cpu, AddressingMode addressing_mode) {
     cpu_write_byte(cpu, cpu_decode_operand_pointer(cpu, addressing_mode), cpu->accumulator & cpu->register_x);
 }
 
 // Load into accumulator and then transfer to register X
-static void cpu_execute_lax(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_lax(Cpu *cpu, AddressingMode addressing_mode) {
     cpu_status_update_zero_and_negative(cpu, cpu->register_x = cpu->accumulator =
                                                  cpu_decode_operand(cpu, addressing_mode));
 }
 
 // Logical And
-static void cpu_execute_and(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_and(Cpu *cpu, AddressingMode addressing_mode) {
     cpu_status_update_zero_and_negative(cpu, cpu->accumulator &= cpu_decode_operand(cpu, addressing_mode));
 }
 
 // Logical Or
-static void cpu_execute_ora(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_ora(Cpu *cpu, AddressingMode addressing_mode) {
     cpu_status_update_zero_and_negative(cpu, cpu->accumulator |= cpu_decode_operand(cpu, addressing_mode));
 }
 
 // Exclusive Or
-static void cpu_execute_eor(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_eor(Cpu *cpu, AddressingMode addressing_mode) {
     cpu_status_update_zero_and_negative(cpu, cpu->accumulator ^= cpu_decode_operand(cpu, addressing_mode));
 }
 
@@ -474,7 +719,7 @@ static void cmp(Cpu *cpu, uint8_t lhs, uint8_t rhs) {
 }
 
 // Decrement value and then compare
-static void cpu_execute_dcp(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_dcp(Cpu *cpu, AddressingMode addressing_mode) {
     uint16_t pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
     uint8_t new_value = cpu_read_byte(cpu, pointer) - 1;
     cpu_write_byte(cpu, pointer, new_value);
@@ -484,22 +729,22 @@ static void cpu_execute_dcp(Cpu *cpu, AddressingMode addressing_mode) {
 
 
 // Compare accumulator with operand
-static void cpu_execute_cmp(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_cmp(Cpu *cpu, AddressingMode addressing_mode) {
     cmp(cpu, cpu->accumulator, cpu_decode_operand(cpu, addressing_mode));
 }
 
 // Compare register X with operand
-static void cpu_execute_cpx(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_cpx(Cpu *cpu, AddressingMode addressing_mode) {
     cmp(cpu, cpu->register_x, cpu_decode_operand(cpu, addressing_mode));
 }
 
 // Compare register Y with operand
-static void cpu_execute_cpy(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_cpy(Cpu *cpu, AddressingMode addressing_mode) {
     cmp(cpu, cpu->register_y, cpu_decode_operand(cpu, addressing_mode));
 }
 
 // Increment
-static void cpu_execute_inc(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_inc(Cpu *cpu, AddressingMode addressing_mode) {
     uint16_t pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
     uint8_t new_value = cpu_read_byte(cpu, pointer) + 1;
     cpu_write_byte(cpu, pointer, new_value);
@@ -513,7 +758,7 @@ static void cpu_execute_inx(Cpu *cpu) { cpu_status_update_zero_and_negative(cpu,
 static void cpu_execute_iny(Cpu *cpu) { cpu_status_update_zero_and_negative(cpu, ++cpu->register_y); }
 
 // Decrement
-static void cpu_execute_dec(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_dec(Cpu *cpu, AddressingMode addressing_mode) {
     uint16_t pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
     uint8_t new_value = cpu_read_byte(cpu, pointer) - 1;
     cpu_write_byte(cpu, pointer, new_value);
@@ -527,7 +772,7 @@ static void cpu_execute_dex(Cpu *cpu) { cpu_status_update_zero_and_negative(cpu,
 static void cpu_execute_dey(Cpu *cpu) { cpu_status_update_zero_and_negative(cpu, --cpu->register_y); }
 
 // Increment then subtract with carry
-static void cpu_execute_isc(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_isc(Cpu *cpu, AddressingMode addressing_mode) {
     uint16_t pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
     uint8_t new_value = cpu_read_byte(cpu, pointer) + 1;
     cpu_write_byte(cpu, pointer, new_value);
@@ -535,7 +780,7 @@ static void cpu_execute_isc(Cpu *cpu, AddressingMode addressing_mode) {
 }
 
 // Bit test
-static void cpu_execute_bit(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_bit(Cpu *cpu, AddressingMode addressing_mode) {
     uint8_t operand = cpu_decode_operand(cpu, addressing_mode);
 
     if ((operand & cpu->accumulator) == 0) {
@@ -558,9 +803,9 @@ static void cpu_execute_bit(Cpu *cpu, AddressingMode addressing_mode) {
 }
 
 // Arithmetic shift left
-static void cpu_execute_asl(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_asl(Cpu *cpu, AddressingMode addressing_mode) {
     uint16_t operand_pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
-    uint8_t operand = cpu_read_byte(cpu, operand_pointer);
+    uint8_t operand = cpu_read_modified(cpu, addressing_mode, operand_pointer);
 
     if (operand & (1 << 7)) {
         cpu_status_set_carry(cpu);
@@ -570,15 +815,15 @@ static void cpu_execute_asl(Cpu *cpu, AddressingMode addressing_mode) {
 
     operand <<= 1;
 
-    cpu_write_byte(cpu, operand_pointer, operand);
+    cpu_write_modified(cpu, addressing_mode, operand_pointer, operand);
 
     cpu_status_update_zero_and_negative(cpu, operand);
 }
 
 // Logical shift right
-static void cpu_execute_lsr(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_lsr(Cpu *cpu, AddressingMode addressing_mode) {
     uint16_t operand_pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
-    uint8_t operand = cpu_read_byte(cpu, operand_pointer);
+    uint8_t operand = cpu_read_modified(cpu, addressing_mode, operand_pointer);
 
     if (operand & 1) {
         cpu_status_set_carry(cpu);
@@ -588,13 +833,13 @@ static void cpu_execute_lsr(Cpu *cpu, AddressingMode addressing_mode) {
 
     operand >>= 1;
 
-    cpu_write_byte(cpu, operand_pointer, operand);
+    cpu_write_modified(cpu, addressing_mode, operand_pointer, operand);
 
     cpu_status_update_zero_and_negative(cpu, operand);
 }
 
 // Arithmetic shift left then perform Logical Or with accumulator
-static void cpu_execute_slo(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_slo(Cpu *cpu, AddressingMode addressing_mode) {
     uint16_t operand_pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
     uint8_t operand = cpu_read_byte(cpu, operand_pointer);
 
@@ -612,7 +857,7 @@ static void cpu_execute_slo(Cpu *cpu, AddressingMode addressing_mode) {
 }
 
 // Logical shift right then perform perform Logical Exclusive Or with the value
-static void cpu_execute_sre(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_sre(Cpu *cpu, AddressingMode addressing_mode) {
     uint16_t operand_pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
     uint8_t operand = cpu_read_byte(cpu, operand_pointer);
 
@@ -630,37 +875,37 @@ static void cpu_execute_sre(Cpu *cpu, AddressingMode addressing_mode) {
 }
 
 // Jump
-static void cpu_execute_jmp(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_jmp(Cpu *cpu, AddressingMode addressing_mode) {
     cpu->instruction_pointer = cpu_decode_operand_pointer(cpu, addressing_mode);
 }
 
 // Store accumulator
-static void cpu_execute_sta(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_sta(Cpu *cpu, AddressingMode addressing_mode) {
     cpu_write_byte(cpu, cpu_decode_operand_pointer(cpu, addressing_mode), cpu->accumulator);
 }
 
 // Load accumulator
-static void cpu_execute_lda(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_lda(Cpu *cpu, AddressingMode addressing_mode) {
     cpu_status_update_zero_and_negative(cpu, cpu->accumulator = cpu_decode_operand(cpu, addressing_mode));
 }
 
 // Store X register
-static void cpu_execute_stx(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_stx(Cpu *cpu, AddressingMode addressing_mode) {
     cpu_write_byte(cpu, cpu_decode_operand_pointer(cpu, addressing_mode), cpu->register_x);
 }
 
 // Load X register
-static void cpu_execute_ldx(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_ldx(Cpu *cpu, AddressingMode addressing_mode) {
     cpu_status_update_zero_and_negative(cpu, cpu->register_x = cpu_decode_operand(cpu, addressing_mode));
 }
 
 // Store Y register
-static void cpu_execute_sty(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_sty(Cpu *cpu, AddressingMode addressing_mode) {
     cpu_write_byte(cpu, cpu_decode_operand_pointer(cpu, addressing_mode), cpu->register_y);
 }
 
 // Load Y register
-static void cpu_execute_ldy(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_ldy(Cpu *cpu, AddressingMode addressing_mode) {
     cpu_status_update_zero_and_negative(cpu, cpu->register_y = cpu_decode_operand(cpu, addressing_mode));
 }
 
@@ -693,264 +938,500 @@ static void cpu_execute_tya(Cpu *cpu) {
 }
 
 // No-op
-static void cpu_execute_nop(Cpu *cpu, AddressingMode addressing_mode) {
+static inline void cpu_execute_nop(Cpu *cpu, AddressingMode addressing_mode) {
     if (addressing_mode != AM_IMPLICIT) {
         cpu_decode_operand(cpu, addressing_mode);
     }
 }
 
-#define CHECK_INSTRUCTION(code, call)                                                                        \
-    case code:                                                                                               \
-        call(cpu);                                                                                           \
-        break
+// Every (instruction, addressing mode) pair gets its own handler so the addressing mode is a constant that the
+// compiler can fold into the operand decoding instead of resolving it at runtime.
+#define SPECIALISE(call, name, addressing_mode)                                                              \
+    static void call##_##name(Cpu *cpu) { call(cpu, addressing_mode); }
+
+#define SPECIALISE_ALU_NO_IMM(call)                                                                          \
+    SPECIALISE(call, zero_page, AM_ZERO_PAGE)                                                                \
+    SPECIALISE(call, zero_page_x, AM_ZERO_PAGE_X)                                                            \
+    SPECIALISE(call, absolute, AM_ABSOLUTE)                                                                  \
+    SPECIALISE(call, absolute_x, AM_ABSOLUTE_X)                                                              \
+    SPECIALISE(call, absolute_y, AM_ABSOLUTE_Y)                                                              \
+    SPECIALISE(call, indirect_x, AM_INDIRECT_X)                                                              \
+    SPECIALISE(call, indirect_y, AM_INDIRECT_Y)
+
+#define SPECIALISE_ALU(call)                                                                                 \
+    SPECIALISE(call, immediate, AM_IMMEDIATE)                                                                \
+    SPECIALISE_ALU_NO_IMM(call)
+
+#define SPECIALISE_RMW(call)                                                                                 \
+    SPECIALISE(call, zero_page, AM_ZERO_PAGE)                                                                \
+    SPECIALISE(call, zero_page_x, AM_ZERO_PAGE_X)                                                            \
+    SPECIALISE(call, absolute, AM_ABSOLUTE)                                                                  \
+    SPECIALISE(call, absolute_x, AM_ABSOLUTE_X)                                                              \
+    SPECIALISE(call, accumulator, AM_ACCUMULATOR)
+
+SPECIALISE_ALU(cpu_execute_adc)
+SPECIALISE_ALU(cpu_execute_sbc)
+SPECIALISE_ALU(cpu_execute_and)
+SPECIALISE_ALU(cpu_execute_ora)
+SPECIALISE_ALU(cpu_execute_eor)
+SPECIALISE_ALU(cpu_execute_cmp)
+SPECIALISE_ALU_NO_IMM(cpu_execute_sta)
+SPECIALISE_ALU(cpu_execute_lda)
+
+SPECIALISE_RMW(cpu_execute_asl)
+SPECIALISE_RMW(cpu_execute_rol)
+SPECIALISE_RMW(cpu_execute_lsr)
+SPECIALISE_RMW(cpu_execute_ror)
+
+SPECIALISE(cpu_execute_ldx, immediate, AM_IMMEDIATE)
+SPECIALISE(cpu_execute_ldx, zero_page, AM_ZERO_PAGE)
+SPECIALISE(cpu_execute_ldx, zero_page_y, AM_ZERO_PAGE_Y)
+SPECIALISE(cpu_execute_ldx, absolute, AM_ABSOLUTE)
+SPECIALISE(cpu_execute_ldx, absolute_y, AM_ABSOLUTE_Y)
+
+SPECIALISE(cpu_execute_ldy, immediate, AM_IMMEDIATE)
+SPECIALISE(cpu_execute_ldy, zero_page, AM_ZERO_PAGE)
+SPECIALISE(cpu_execute_ldy, absolute, AM_ABSOLUTE)
+SPECIALISE(cpu_execute_ldy, zero_page_x, AM_ZERO_PAGE_X)
+SPECIALISE(cpu_execute_ldy, absolute_x, AM_ABSOLUTE_X)
+
+SPECIALISE(cpu_execute_stx, zero_page, AM_ZERO_PAGE)
+SPECIALISE(cpu_execute_stx, zero_page_y, AM_ZERO_PAGE_Y)
+SPECIALISE(cpu_execute_stx, absolute, AM_ABSOLUTE)
+
+SPECIALISE(cpu_execute_sty, zero_page, AM_ZERO_PAGE)
+SPECIALISE(cpu_execute_sty, zero_page_x, AM_ZERO_PAGE_X)
+SPECIALISE(cpu_execute_sty, absolute, AM_ABSOLUTE)
+
+SPECIALISE(cpu_execute_cpx, immediate, AM_IMMEDIATE)
+SPECIALISE(cpu_execute_cpx, zero_page, AM_ZERO_PAGE)
+SPECIALISE(cpu_execute_cpx, absolute, AM_ABSOLUTE)
+
+SPECIALISE(cpu_execute_cpy, immediate, AM_IMMEDIATE)
+SPECIALISE(cpu_execute_cpy, zero_page, AM_ZERO_PAGE)
+SPECIALISE(cpu_execute_cpy, absolute, AM_ABSOLUTE)
+
+SPECIALISE(cpu_execute_inc, zero_page, AM_ZERO_PAGE)
+SPECIALISE(cpu_execute_inc, absolute, AM_ABSOLUTE)
+SPECIALISE(cpu_execute_inc, zero_page_x, AM_ZERO_PAGE_X)
+SPECIALISE(cpu_execute_inc, absolute_x, AM_ABSOLUTE_X)
+
+SPECIALISE(cpu_execute_dec, zero_page, AM_ZERO_PAGE)
+SPECIALISE(cpu_execute_dec, zero_page_x, AM_ZERO_PAGE_X)
+SPECIALISE(cpu_execute_dec, absolute, AM_ABSOLUTE)
+SPECIALISE(cpu_execute_dec, absolute_x, AM_ABSOLUTE_X)
+
+SPECIALISE(cpu_execute_jmp, absolute, AM_ABSOLUTE)
+SPECIALISE(cpu_execute_jmp, indirect, AM_INDIRECT_JMP)
+
+SPECIALISE(cpu_execute_bit, zero_page, AM_ZERO_PAGE)
+SPECIALISE(cpu_execute_bit, absolute, AM_ABSOLUTE)
+
+SPECIALISE(cpu_execute_nop, implicit, AM_IMPLICIT)
+SPECIALISE(cpu_execute_nop, immediate, AM_IMMEDIATE)
+SPECIALISE(cpu_execute_nop, zero_page, AM_ZERO_PAGE)
+SPECIALISE(cpu_execute_nop, absolute, AM_ABSOLUTE)
+SPECIALISE(cpu_execute_nop, zero_page_x, AM_ZERO_PAGE_X)
+SPECIALISE(cpu_execute_nop, absolute_x, AM_ABSOLUTE_X)
+
+SPECIALISE_ALU_NO_IMM(cpu_execute_slo)
+SPECIALISE_ALU_NO_IMM(cpu_execute_rla)
+SPECIALISE_ALU_NO_IMM(cpu_execute_sre)
+SPECIALISE_ALU_NO_IMM(cpu_execute_rra)
+SPECIALISE_ALU_NO_IMM(cpu_execute_dcp)
+SPECIALISE_ALU_NO_IMM(cpu_execute_isc)
+
+SPECIALISE(cpu_execute_sax, indirect_x, AM_INDIRECT_X)
+SPECIALISE(cpu_execute_sax, zero_page, AM_ZERO_PAGE)
+SPECIALISE(cpu_execute_sax, zero_page_y, AM_ZERO_PAGE_Y)
+SPECIALISE(cpu_execute_sax, absolute, AM_ABSOLUTE)
+
+SPECIALISE(cpu_execute_lax, indirect_x, AM_INDIRECT_X)
+SPECIALISE(cpu_execute_lax, immediate, AM_IMMEDIATE)
+SPECIALISE(cpu_execute_lax, zero_page, AM_ZERO_PAGE)
+SPECIALISE(cpu_execute_lax, zero_page_y, AM_ZERO_PAGE_Y)
+SPECIALISE(cpu_execute_lax, absolute, AM_ABSOLUTE)
+SPECIALISE(cpu_execute_lax, indirect_y, AM_INDIRECT_Y)
+SPECIALISE(cpu_execute_lax, absolute_y, AM_ABSOLUTE_Y)
+
+#define INSTRUCTION(code, call) [code] = call
+
+#define INSTRUCTION_WITH_AM(code, call, offset, name) [code + offset] = call##_##name
+
+#define ALU_INSTRUCTION_NO_IMM(code, call)                                                                   \
+    INSTRUCTION_WITH_AM(code, call, 0x5, zero_page), INSTRUCTION_WITH_AM(code, call, 0x15, zero_page_x),     \
+        INSTRUCTION_WITH_AM(code, call, 0xd, absolute), INSTRUCTION_WITH_AM(code, call, 0x1d, absolute_x),   \
+        INSTRUCTION_WITH_AM(code, call, 0x19, absolute_y), INSTRUCTION_WITH_AM(code, call, 0x1, indirect_x), \
+        INSTRUCTION_WITH_AM(code, call, 0x11, indirect_y)
+
+#define ALU_INSTRUCTION(code, call)                                                                          \
+    INSTRUCTION_WITH_AM(code, call, 0x9, immediate), ALU_INSTRUCTION_NO_IMM(code, call)
+
+#define RMW_INSTRUCTION(code, call)                                                                          \
+    INSTRUCTION_WITH_AM(code, call, 0x6, zero_page), INSTRUCTION_WITH_AM(code, call, 0x16, zero_page_x),     \
+        INSTRUCTION_WITH_AM(code, call, 0xe, absolute), INSTRUCTION_WITH_AM(code, call, 0x1e, absolute_x),   \
+        INSTRUCTION_WITH_AM(code, call, 0xa, accumulator)
+
+// Unofficial read-modify-write instructions share the ALU layout, shifted by two opcodes
+#define UNOFFICIAL_RMW_INSTRUCTION(code, call)                                                               \
+    INSTRUCTION_WITH_AM(code, call, 0x3, indirect_x), INSTRUCTION_WITH_AM(code, call, 0x7, zero_page),       \
+        INSTRUCTION_WITH_AM(code, call, 0x17, zero_page_x), INSTRUCTION_WITH_AM(code, call, 0xf, absolute),  \
+        INSTRUCTION_WITH_AM(code, call, 0x13, indirect_y), INSTRUCTION_WITH_AM(code, call, 0x1f, absolute_x), \
+        INSTRUCTION_WITH_AM(code, call, 0x1b, absolute_y)
+
+typedef void (*CpuInstruction)(Cpu *);
+
+// Opcodes that are left out are unknown and have no handler
+static const CpuInstruction cpu_instructions[256] = {
+    INSTRUCTION(OP_PHP, cpu_execute_php),
+    INSTRUCTION(OP_PLP, cpu_execute_plp),
+    INSTRUCTION(OP_PHA, cpu_execute_pha),
+    INSTRUCTION(OP_PLA, cpu_execute_pla),
+    INSTRUCTION(OP_JSR, cpu_execute_jsr),
+    INSTRUCTION(OP_RTS, cpu_execute_rts),
+    INSTRUCTION(OP_RTI, cpu_execute_rti),
+
+    ALU_INSTRUCTION(OP_ADC, cpu_execute_adc),
+    ALU_INSTRUCTION(OP_SBC, cpu_execute_sbc),
+    ALU_INSTRUCTION(OP_AND, cpu_execute_and),
+    ALU_INSTRUCTION(OP_ORA, cpu_execute_ora),
+    ALU_INSTRUCTION(OP_EOR, cpu_execute_eor),
+    ALU_INSTRUCTION(OP_CMP, cpu_execute_cmp),
+    ALU_INSTRUCTION_NO_IMM(OP_STA, cpu_execute_sta),
+    ALU_INSTRUCTION(OP_LDA, cpu_execute_lda),
+
+    RMW_INSTRUCTION(OP_ASL, cpu_execute_asl),
+    RMW_INSTRUCTION(OP_ROL, cpu_execute_rol),
+    RMW_INSTRUCTION(OP_LSR, cpu_execute_lsr),
+    RMW_INSTRUCTION(OP_ROR, cpu_execute_ror),
+
+    INSTRUCTION_WITH_AM(OP_LDX, cpu_execute_ldx, 0x02, immediate),
+    INSTRUCTION_WITH_AM(OP_LDX, cpu_execute_ldx, 0x06, zero_page),
+    INSTRUCTION_WITH_AM(OP_LDX, cpu_execute_ldx, 0x16, zero_page_y),
+    INSTRUCTION_WITH_AM(OP_LDX, cpu_execute_ldx, 0x0e, absolute),
+    INSTRUCTION_WITH_AM(OP_LDX, cpu_execute_ldx, 0x1e, absolute_y),
+
+    INSTRUCTION_WITH_AM(OP_LDY, cpu_execute_ldy, 0x00, immediate),
+    INSTRUCTION_WITH_AM(OP_LDY, cpu_execute_ldy, 0x04, zero_page),
+    INSTRUCTION_WITH_AM(OP_LDY, cpu_execute_ldy, 0x0c, absolute),
+    INSTRUCTION_WITH_AM(OP_LDY, cpu_execute_ldy, 0x14, zero_page_x),
+    INSTRUCTION_WITH_AM(OP_LDY, cpu_execute_ldy, 0x1c, absolute_x),
+
+    INSTRUCTION_WITH_AM(OP_STX, cpu_execute_stx, 0x06, zero_page),
+    INSTRUCTION_WITH_AM(OP_STX, cpu_execute_stx, 0x16, zero_page_y),
+    INSTRUCTION_WITH_AM(OP_STX, cpu_execute_stx, 0x0e, absolute),
+
+    INSTRUCTION_WITH_AM(OP_STY, cpu_execute_sty, 0x04, zero_page),
+    INSTRUCTION_WITH_AM(OP_STY, cpu_execute_sty, 0x14, zero_page_x),
+    INSTRUCTION_WITH_AM(OP_STY, cpu_execute_sty, 0x0c, absolute),
+
+    INSTRUCTION_WITH_AM(OP_CPX, cpu_execute_cpx, 0x00, immediate),
+    INSTRUCTION_WITH_AM(OP_CPX, cpu_execute_cpx, 0x04, zero_page),
+    INSTRUCTION_WITH_AM(OP_CPX, cpu_execute_cpx, 0x0c, absolute),
+
+    INSTRUCTION_WITH_AM(OP_CPY, cpu_execute_cpy, 0x00, immediate),
+    INSTRUCTION_WITH_AM(OP_CPY, cpu_execute_cpy, 0x04, zero_page),
+    INSTRUCTION_WITH_AM(OP_CPY, cpu_execute_cpy, 0x0c, absolute),
+
+    INSTRUCTION(OP_TAX, cpu_execute_tax),
+    INSTRUCTION(OP_TAY, cpu_execute_tay),
+    INSTRUCTION(OP_TSX, cpu_execute_tsx),
+    INSTRUCTION(OP_TXA, cpu_execute_txa),
+    INSTRUCTION(OP_TXS, cpu_execute_txs),
+    INSTRUCTION(OP_TYA, cpu_execute_tya),
+
+    INSTRUCTION_WITH_AM(OP_INC, cpu_execute_inc, 0x06, zero_page),
+    INSTRUCTION_WITH_AM(OP_INC, cpu_execute_inc, 0x0e, absolute),
+    INSTRUCTION_WITH_AM(OP_INC, cpu_execute_inc, 0x16, zero_page_x),
+    INSTRUCTION_WITH_AM(OP_INC, cpu_execute_inc, 0x1e, absolute_x),
+
+    INSTRUCTION(OP_INX, cpu_execute_inx),
+    INSTRUCTION(OP_INY, cpu_execute_iny),
+
+    INSTRUCTION_WITH_AM(OP_DEC, cpu_execute_dec, 0x06, zero_page),
+    INSTRUCTION_WITH_AM(OP_DEC, cpu_execute_dec, 0x16, zero_page_x),
+    INSTRUCTION_WITH_AM(OP_DEC, cpu_execute_dec, 0x0e, absolute),
+    INSTRUCTION_WITH_AM(OP_DEC, cpu_execute_dec, 0x1e, absolute_x),
+
+    INSTRUCTION(OP_DEX, cpu_execute_dex),
+    INSTRUCTION(OP_DEY, cpu_execute_dey),
+
+    INSTRUCTION(OP_SEC, cpu_status_set_carry),
+    INSTRUCTION(OP_SED, cpu_status_set_decimal_mode),
+    INSTRUCTION(OP_SEI, cpu_status_disable_interrupts),
+    INSTRUCTION(OP_CLC, cpu_status_clear_carry),
+    INSTRUCTION(OP_CLD, cpu_status_clear_decimal_mode),
+    INSTRUCTION(OP_CLI, cpu_execute_cli),
+    INSTRUCTION(OP_CLV, cpu_status_clear_overflow),
+
+    INSTRUCTION_WITH_AM(OP_JMP, cpu_execute_jmp, 0x40, absolute),
+    INSTRUCTION_WITH_AM(OP_JMP, cpu_execute_jmp, 0x60, indirect),
+
+    INSTRUCTION_WITH_AM(OP_BIT, cpu_execute_bit, 0x04, zero_page),
+    INSTRUCTION_WITH_AM(OP_BIT, cpu_execute_bit, 0x0c, absolute),
+
+    INSTRUCTION(OP_BPL, cpu_execute_bpl),
+    INSTRUCTION(OP_BMI, cpu_execute_bmi),
+    INSTRUCTION(OP_BVC, cpu_execute_bvc),
+    INSTRUCTION(OP_BVS, cpu_execute_bvs),
+    INSTRUCTION(OP_BCC, cpu_execute_bcc),
+    INSTRUCTION(OP_BCS, cpu_execute_bcs),
+    INSTRUCTION(OP_BNE, cpu_execute_bne),
+    INSTRUCTION(OP_BEQ, cpu_execute_beq),
+
+    INSTRUCTION(0x00, cpu_stop),
+    INSTRUCTION(0x02, cpu_stop),
+    INSTRUCTION(0x12, cpu_stop),
+    INSTRUCTION(0x22, cpu_stop),
+    INSTRUCTION(0x32, cpu_stop),
+    INSTRUCTION(0x42, cpu_stop),
+    INSTRUCTION(0x52, cpu_stop),
+    INSTRUCTION(0x62, cpu_stop),
+    INSTRUCTION(0x72, cpu_stop),
+    INSTRUCTION(0x92, cpu_stop),
+    INSTRUCTION(0xb2, cpu_stop),
+    INSTRUCTION(0xd2, cpu_stop),
+    INSTRUCTION(0xf2, cpu_stop),
+
+    INSTRUCTION_WITH_AM(0xea, cpu_execute_nop, 0x00, implicit),
+    INSTRUCTION_WITH_AM(0x80, cpu_execute_nop, 0x00, immediate),
+
+    INSTRUCTION_WITH_AM(0x04, cpu_execute_nop, 0x00, zero_page),
+    INSTRUCTION_WITH_AM(0x44, cpu_execute_nop, 0x00, zero_page),
+    INSTRUCTION_WITH_AM(0x64, cpu_execute_nop, 0x00, zero_page),
+
+    INSTRUCTION_WITH_AM(0x0c, cpu_execute_nop, 0x00, absolute),
+
+    INSTRUCTION_WITH_AM(0x14, cpu_execute_nop, 0x00, zero_page_x),
+    INSTRUCTION_WITH_AM(0x34, cpu_execute_nop, 0x00, zero_page_x),
+    INSTRUCTION_WITH_AM(0x54, cpu_execute_nop, 0x00, zero_page_x),
+    INSTRUCTION_WITH_AM(0x74, cpu_execute_nop, 0x00, zero_page_x),
+    INSTRUCTION_WITH_AM(0xd4, cpu_execute_nop, 0x00, zero_page_x),
+    INSTRUCTION_WITH_AM(0xf4, cpu_execute_nop, 0x00, zero_page_x),
+
+    INSTRUCTION_WITH_AM(0x1c, cpu_execute_nop, 0x00, absolute_x),
+    INSTRUCTION_WITH_AM(0x3c, cpu_execute_nop, 0x00, absolute_x),
+    INSTRUCTION_WITH_AM(0x5c, cpu_execute_nop, 0x00, absolute_x),
+    INSTRUCTION_WITH_AM(0x7c, cpu_execute_nop, 0x00, absolute_x),
+    INSTRUCTION_WITH_AM(0xdc, cpu_execute_nop, 0x00, absolute_x),
+    INSTRUCTION_WITH_AM(0xfc, cpu_execute_nop, 0x00, absolute_x),
+
+    INSTRUCTION_WITH_AM(0x89, cpu_execute_nop, 0x00, immediate),
+
+    INSTRUCTION_WITH_AM(0x82, cpu_execute_nop, 0x00, immediate),
+    INSTRUCTION_WITH_AM(0xc2, cpu_execute_nop, 0x00, immediate),
+    INSTRUCTION_WITH_AM(0xe2, cpu_execute_nop, 0x00, immediate),
+
+    INSTRUCTION_WITH_AM(0x1a, cpu_execute_nop, 0x00, implicit),
+    INSTRUCTION_WITH_AM(0x3a, cpu_execute_nop, 0x00, implicit),
+    INSTRUCTION_WITH_AM(0x5a, cpu_execute_nop, 0x00, implicit),
+    INSTRUCTION_WITH_AM(0x7a, cpu_execute_nop, 0x00, implicit),
+    INSTRUCTION_WITH_AM(0xda, cpu_execute_nop, 0x00, implicit),
+    INSTRUCTION_WITH_AM(0xfa, cpu_execute_nop, 0x00, implicit),
+
+    UNOFFICIAL_RMW_INSTRUCTION(OP_SLO, cpu_execute_slo),
+    UNOFFICIAL_RMW_INSTRUCTION(OP_RLA, cpu_execute_rla),
+    UNOFFICIAL_RMW_INSTRUCTION(OP_SRE, cpu_execute_sre),
+    UNOFFICIAL_RMW_INSTRUCTION(OP_RRA, cpu_execute_rra),
+    UNOFFICIAL_RMW_INSTRUCTION(OP_DCP, cpu_execute_dcp),
+    UNOFFICIAL_RMW_INSTRUCTION(OP_ISC, cpu_execute_isc),
+
+    INSTRUCTION_WITH_AM(OP_SAX, cpu_execute_sax, 0x03, indirect_x),
+    INSTRUCTION_WITH_AM(OP_SAX, cpu_execute_sax, 0x07, zero_page),
+    INSTRUCTION_WITH_AM(OP_SAX, cpu_execute_sax, 0x17, zero_page_y),
+    INSTRUCTION_WITH_AM(OP_SAX, cpu_execute_sax, 0x0f, absolute),
+
+    INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x03, indirect_x),
+    INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x0b, immediate),
+    INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x07, zero_page),
+    INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x17, zero_page_y),
+    INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x0f, absolute),
+    INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x13, indirect_y),
+    INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x1f, absolute_y),
+
+    INSTRUCTION_WITH_AM(OP_SBC, cpu_execute_sbc, 0x0b, immediate),
+};
+
+// Base cycles taken by each opcode, page crossings and taken branches are added on top while executing
+static const uint8_t cpu_instruction_cycles[256] = {
+    7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6, // 0x00
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 0x10
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6, // 0x20
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 0x30
+    6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6, // 0x40
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 0x50
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6, // 0x60
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 0x70
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4, // 0x80
+    2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5, // 0x90
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4, // 0xA0
+    2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4, // 0xB0
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6, // 0xC0
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 0xD0
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6, // 0xE0
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 0xF0
+};
 
-#define CHECK_INSTRUCTION_WITH_AM(code, call, offset, addressing_mode)                                       \
-    case code + offset:                                                                                      \
-        call(cpu, addressing_mode);                                                                          \
-        break
+static void cpu_execute_instruction(Cpu *cpu) {
+    uint8_t instruction = cpu_read_byte(cpu, cpu->instruction_pointer);
 
-#define CHECK_ALU_INSTRUCTION_NO_IMM(code, call)                                                             \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0x5, AM_ZERO_PAGE);                                                \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0x15, AM_ZERO_PAGE_X);                                             \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0xd, AM_ABSOLUTE);                                                 \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0x1d, AM_ABSOLUTE_X);                                              \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0x19, AM_ABSOLUTE_Y);                                              \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0x1, AM_INDIRECT_X);                                               \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0x11, AM_INDIRECT_Y);
+#ifdef LOYD_PROFILE
+    cpu->profile.opcodes[instruction]++;
+    cpu->profile.instruction_pointers[cpu->instruction_pointer]++;
+#endif
 
-#define CHECK_ALU_INSTRUCTION(code, call)                                                                    \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0x9, AM_IMMEDIATE);                                                \
-    CHECK_ALU_INSTRUCTION_NO_IMM(code, call);
+    cpu->instruction_pointer++;
 
-#define CHECK_RMW_INSTRUCTION(code, call)                                                                    \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0x6, AM_ZERO_PAGE);                                                \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0x16, AM_ZERO_PAGE_X);                                             \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0xe, AM_ABSOLUTE);                                                 \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0x1e, AM_ABSOLUTE_X);                                              \
-    CHECK_INSTRUCTION_WITH_AM(code, call, 0xa, AM_ACCUMULATOR);
+    CpuInstruction execute = cpu_instructions[instruction];
 
-static void cpu_execute_instruction(Cpu *cpu) {
-    uint8_t instruction = cpu_read_byte(cpu, cpu->instruction_pointer);
+    if (execute == NULL) {
+        cpu->instruction_pointer--;
 
-    cpu->instruction_pointer++;
+        cpu_fault(cpu, FAULT_ILLEGAL_OPCODE, "unknown instruction with code 0x%x at 0x%04x", instruction,
+                  cpu->instruction_pointer);
+
+        cpu->fault.opcode = instruction;
+
+        return;
+    }
+
+    execute(cpu);
 
-    switch (instruction) {
-        CHECK_INSTRUCTION(OP_PHP, cpu_execute_php);
-        CHECK_INSTRUCTION(OP_PLP, cpu_execute_plp);
-        CHECK_INSTRUCTION(OP_PHA, cpu_execute_pha);
-        CHECK_INSTRUCTION(OP_PLA, cpu_execute_pla);
-        CHECK_INSTRUCTION(OP_JSR, cpu_execute_jsr);
-        CHECK_INSTRUCTION(OP_RTS, cpu_execute_rts);
-
-        CHECK_ALU_INSTRUCTION(OP_ADC, cpu_execute_adc);
-        CHECK_ALU_INSTRUCTION(OP_SBC, cpu_execute_sbc);
-        CHECK_ALU_INSTRUCTION(OP_AND, cpu_execute_and);
-        CHECK_ALU_INSTRUCTION(OP_ORA, cpu_execute_ora);
-        CHECK_ALU_INSTRUCTION(OP_EOR, cpu_execute_eor);
-        CHECK_ALU_INSTRUCTION(OP_CMP, cpu_execute_cmp);
-        CHECK_ALU_INSTRUCTION_NO_IMM(OP_STA, cpu_execute_sta);
-        CHECK_ALU_INSTRUCTION(OP_LDA, cpu_execute_lda);
-
-        CHECK_RMW_INSTRUCTION(OP_ASL, cpu_execute_asl);
-        CHECK_RMW_INSTRUCTION(OP_ROL, cpu_execute_rol);
-        CHECK_RMW_INSTRUCTION(OP_LSR, cpu_execute_lsr);
-        CHECK_RMW_INSTRUCTION(OP_ROR, cpu_execute_ror);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_LDX, cpu_execute_ldx, 0x02, AM_IMMEDIATE);
-        CHECK_INSTRUCTION_WITH_AM(OP_LDX, cpu_execute_ldx, 0x06, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_LDX, cpu_execute_ldx, 0x16, AM_ZERO_PAGE_Y);
-        CHECK_INSTRUCTION_WITH_AM(OP_LDX, cpu_execute_ldx, 0x0e, AM_ABSOLUTE);
-        CHECK_INSTRUCTION_WITH_AM(OP_LDX, cpu_execute_ldx, 0x1e, AM_ABSOLUTE_Y);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_LDY, cpu_execute_ldy, 0x00, AM_IMMEDIATE);
-        CHECK_INSTRUCTION_WITH_AM(OP_LDY, cpu_execute_ldy, 0x04, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_LDY, cpu_execute_ldy, 0x0c, AM_ABSOLUTE);
-        CHECK_INSTRUCTION_WITH_AM(OP_LDY, cpu_execute_ldy, 0x14, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_LDY, cpu_execute_ldy, 0x1c, AM_ABSOLUTE_Y);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_STX, cpu_execute_stx, 0x06, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_STX, cpu_execute_stx, 0x16, AM_ZERO_PAGE_Y);
-        CHECK_INSTRUCTION_WITH_AM(OP_STX, cpu_execute_stx, 0x0e, AM_ABSOLUTE);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_STY, cpu_execute_sty, 0x04, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_STY, cpu_execute_sty, 0x14, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_STY, cpu_execute_sty, 0x0c, AM_ABSOLUTE);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_CPX, cpu_execute_cpx, 0x00, AM_IMMEDIATE);
-        CHECK_INSTRUCTION_WITH_AM(OP_CPX, cpu_execute_cpx, 0x04, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_CPX, cpu_execute_cpx, 0x0c, AM_ABSOLUTE);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_CPY, cpu_execute_cpy, 0x00, AM_IMMEDIATE);
-        CHECK_INSTRUCTION_WITH_AM(OP_CPY, cpu_execute_cpy, 0x04, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_CPY, cpu_execute_cpy, 0x0c, AM_ABSOLUTE);
-
-        CHECK_INSTRUCTION(OP_TAX, cpu_execute_tax);
-        CHECK_INSTRUCTION(OP_TAY, cpu_execute_tay);
-        CHECK_INSTRUCTION(OP_TSX, cpu_execute_tsx);
-        CHECK_INSTRUCTION(OP_TXA, cpu_execute_txa);
-        CHECK_INSTRUCTION(OP_TXS, cpu_execute_txs);
-        CHECK_INSTRUCTION(OP_TYA, cpu_execute_tya);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_INC, cpu_execute_inc, 0x06, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_INC, cpu_execute_inc, 0x0e, AM_ABSOLUTE);
-        CHECK_INSTRUCTION_WITH_AM(OP_INC, cpu_execute_inc, 0x16, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_INC, cpu_execute_inc, 0x1e, AM_ABSOLUTE_X);
-
-        CHECK_INSTRUCTION(OP_INX, cpu_execute_inx);
-        CHECK_INSTRUCTION(OP_INY, cpu_execute_iny);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_DEC, cpu_execute_dec, 0x06, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_DEC, cpu_execute_dec, 0x16, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_DEC, cpu_execute_dec, 0x0e, AM_ABSOLUTE);
-        CHECK_INSTRUCTION_WITH_AM(OP_DEC, cpu_execute_dec, 0x1e, AM_ABSOLUTE_X);
-
-        CHECK_INSTRUCTION(OP_DEX, cpu_execute_dex);
-        CHECK_INSTRUCTION(OP_DEY, cpu_execute_dey);
-
-        CHECK_INSTRUCTION(OP_SEC, cpu_status_set_carry);
-        CHECK_INSTRUCTION(OP_SED, cpu_status_set_decimal_mode);
-        CHECK_INSTRUCTION(OP_SEI, cpu_status_disable_interrupts);
-        CHECK_INSTRUCTION(OP_CLC, cpu_status_clear_carry);
-        CHECK_INSTRUCTION(OP_CLD, cpu_status_clear_decimal_mode);
-        CHECK_INSTRUCTION(OP_CLI, cpu_status_enable_interrupts);
-        CHECK_INSTRUCTION(OP_CLV, cpu_status_clear_overflow);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_JMP, cpu_execute_jmp, 0x40, AM_ABSOLUTE);
-        CHECK_INSTRUCTION_WITH_AM(OP_JMP, cpu_execute_jmp, 0x60, AM_INDIRECT_JMP);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_BIT, cpu_execute_bit, 0x04, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_BIT, cpu_execute_bit, 0x0c, AM_ABSOLUTE);
-
-        CHECK_INSTRUCTION(OP_BPL, cpu_execute_bpl);
-        CHECK_INSTRUCTION(OP_BMI, cpu_execute_bmi);
-        CHECK_INSTRUCTION(OP_BVC, cpu_execute_bvc);
-        CHECK_INSTRUCTION(OP_BVS, cpu_execute_bvs);
-        CHECK_INSTRUCTION(OP_BCC, cpu_execute_bcc);
-        CHECK_INSTRUCTION(OP_BCS, cpu_execute_bcs);
-        CHECK_INSTRUCTION(OP_BNE, cpu_execute_bne);
-        CHECK_INSTRUCTION(OP_BEQ, cpu_execute_beq);
-
-        CHECK_INSTRUCTION(0x00, cpu_stop);
-        CHECK_INSTRUCTION(0x02, cpu_stop);
-        CHECK_INSTRUCTION(0x12, cpu_stop);
-        CHECK_INSTRUCTION(0x22, cpu_stop);
-        CHECK_INSTRUCTION(0x32, cpu_stop);
-        CHECK_INSTRUCTION(0x42, cpu_stop);
-        CHECK_INSTRUCTION(0x52, cpu_stop);
-        CHECK_INSTRUCTION(0x62, cpu_stop);
-        CHECK_INSTRUCTION(0x72, cpu_stop);
-        CHECK_INSTRUCTION(0x92, cpu_stop);
-        CHECK_INSTRUCTION(0xb2, cpu_stop);
-        CHECK_INSTRUCTION(0xd2, cpu_stop);
-        CHECK_INSTRUCTION(0xf2, cpu_stop);
-
-        CHECK_INSTRUCTION_WITH_AM(0xea, cpu_execute_nop, 0x00, AM_IMPLICIT);
-        CHECK_INSTRUCTION_WITH_AM(0x80, cpu_execute_nop, 0x00, AM_IMMEDIATE);
-
-        CHECK_INSTRUCTION_WITH_AM(0x04, cpu_execute_nop, 0x00, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(0x44, cpu_execute_nop, 0x00, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(0x64, cpu_execute_nop, 0x00, AM_ZERO_PAGE);
-
-        CHECK_INSTRUCTION_WITH_AM(0x0c, cpu_execute_nop, 0x00, AM_ABSOLUTE);
-
-        CHECK_INSTRUCTION_WITH_AM(0x14, cpu_execute_nop, 0x00, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(0x34, cpu_execute_nop, 0x00, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(0x54, cpu_execute_nop, 0x00, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(0x74, cpu_execute_nop, 0x00, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(0xd4, cpu_execute_nop, 0x00, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(0xf4, cpu_execute_nop, 0x00, AM_ZERO_PAGE_X);
-
-        CHECK_INSTRUCTION_WITH_AM(0x1c, cpu_execute_nop, 0x00, AM_ABSOLUTE_X);
-        CHECK_INSTRUCTION_WITH_AM(0x3c, cpu_execute_nop, 0x00, AM_ABSOLUTE_X);
-        CHECK_INSTRUCTION_WITH_AM(0x5c, cpu_execute_nop, 0x00, AM_ABSOLUTE_X);
-        CHECK_INSTRUCTION_WITH_AM(0x7c, cpu_execute_nop, 0x00, AM_ABSOLUTE_X);
-        CHECK_INSTRUCTION_WITH_AM(0xdc, cpu_execute_nop, 0x00, AM_ABSOLUTE_X);
-        CHECK_INSTRUCTION_WITH_AM(0xfc, cpu_execute_nop, 0x00, AM_ABSOLUTE_X);
-
-        CHECK_INSTRUCTION_WITH_AM(0x89, cpu_execute_nop, 0x00, AM_IMMEDIATE);
-
-        CHECK_INSTRUCTION_WITH_AM(0x82, cpu_execute_nop, 0x00, AM_IMMEDIATE);
-        CHECK_INSTRUCTION_WITH_AM(0xc2, cpu_execute_nop, 0x00, AM_IMMEDIATE);
-        CHECK_INSTRUCTION_WITH_AM(0xe2, cpu_execute_nop, 0x00, AM_IMMEDIATE);
-
-        CHECK_INSTRUCTION_WITH_AM(0x1a, cpu_execute_nop, 0x00, AM_IMPLICIT);
-        CHECK_INSTRUCTION_WITH_AM(0x3a, cpu_execute_nop, 0x00, AM_IMPLICIT);
-        CHECK_INSTRUCTION_WITH_AM(0x5a, cpu_execute_nop, 0x00, AM_IMPLICIT);
-        CHECK_INSTRUCTION_WITH_AM(0x7a, cpu_execute_nop, 0x00, AM_IMPLICIT);
-        CHECK_INSTRUCTION_WITH_AM(0xda, cpu_execute_nop, 0x00, AM_IMPLICIT);
-        CHECK_INSTRUCTION_WITH_AM(0xfa, cpu_execute_nop, 0x00, AM_IMPLICIT);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_SLO, cpu_execute_slo, 0x03, AM_INDIRECT_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_SLO, cpu_execute_slo, 0x07, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_SLO, cpu_execute_slo, 0x17, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_SLO, cpu_execute_slo, 0x0f, AM_ABSOLUTE);
-        CHECK_INSTRUCTION_WITH_AM(OP_SLO, cpu_execute_slo, 0x13, AM_INDIRECT_Y);
-        CHECK_INSTRUCTION_WITH_AM(OP_SLO, cpu_execute_slo, 0x1f, AM_ABSOLUTE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_SLO, cpu_execute_slo, 0x1b, AM_ABSOLUTE_Y);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_RLA, cpu_execute_rla, 0x03, AM_INDIRECT_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_RLA, cpu_execute_rla, 0x07, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_RLA, cpu_execute_rla, 0x17, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_RLA, cpu_execute_rla, 0x0f, AM_ABSOLUTE);
-        CHECK_INSTRUCTION_WITH_AM(OP_RLA, cpu_execute_rla, 0x13, AM_INDIRECT_Y);
-        CHECK_INSTRUCTION_WITH_AM(OP_RLA, cpu_execute_rla, 0x1f, AM_ABSOLUTE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_RLA, cpu_execute_rla, 0x1b, AM_ABSOLUTE_Y);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_SRE, cpu_execute_sre, 0x03, AM_INDIRECT_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_SRE, cpu_execute_sre, 0x07, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_SRE, cpu_execute_sre, 0x17, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_SRE, cpu_execute_sre, 0x0f, AM_ABSOLUTE);
-        CHECK_INSTRUCTION_WITH_AM(OP_SRE, cpu_execute_sre, 0x13, AM_INDIRECT_Y);
-        CHECK_INSTRUCTION_WITH_AM(OP_SRE, cpu_execute_sre, 0x1f, AM_ABSOLUTE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_SRE, cpu_execute_sre, 0x1b, AM_ABSOLUTE_Y);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_RRA, cpu_execute_rra, 0x03, AM_INDIRECT_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_RRA, cpu_execute_rra, 0x07, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_RRA, cpu_execute_rra, 0x17, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_RRA, cpu_execute_rra, 0x0f, AM_ABSOLUTE);
-        CHECK_INSTRUCTION_WITH_AM(OP_RRA, cpu_execute_rra, 0x13, AM_INDIRECT_Y);
-        CHECK_INSTRUCTION_WITH_AM(OP_RRA, cpu_execute_rra, 0x1f, AM_ABSOLUTE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_RRA, cpu_execute_rra, 0x1b, AM_ABSOLUTE_Y);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_SAX, cpu_execute_sax, 0x03, AM_INDIRECT_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_SAX, cpu_execute_sax, 0x07, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_SAX, cpu_execute_sax, 0x17, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_SAX, cpu_execute_sax, 0x0f, AM_ABSOLUTE);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x03, AM_INDIRECT_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x0b, AM_IMMEDIATE);
-        CHECK_INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x07, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x17, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x0f, AM_ABSOLUTE);
-        CHECK_INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x13, AM_INDIRECT_Y);
-        CHECK_INSTRUCTION_WITH_AM(OP_LAX, cpu_execute_lax, 0x1f, AM_ABSOLUTE_X);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_DCP, cpu_execute_dcp, 0x03, AM_INDIRECT_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_DCP, cpu_execute_dcp, 0x07, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_DCP, cpu_execute_dcp, 0x17, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_DCP, cpu_execute_dcp, 0x0f, AM_ABSOLUTE);
-        CHECK_INSTRUCTION_WITH_AM(OP_DCP, cpu_execute_dcp, 0x13, AM_INDIRECT_Y);
-        CHECK_INSTRUCTION_WITH_AM(OP_DCP, cpu_execute_dcp, 0x1f, AM_ABSOLUTE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_DCP, cpu_execute_dcp, 0x1b, AM_ABSOLUTE_Y);
-
-        CHECK_INSTRUCTION_WITH_AM(OP_ISC, cpu_execute_isc, 0x03, AM_INDIRECT_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_ISC, cpu_execute_isc, 0x07, AM_ZERO_PAGE);
-        CHECK_INSTRUCTION_WITH_AM(OP_SBC, cpu_execute_sbc, 0x0b, AM_IMMEDIATE);
-        CHECK_INSTRUCTION_WITH_AM(OP_ISC, cpu_execute_isc, 0x0f, AM_ABSOLUTE);
-        CHECK_INSTRUCTION_WITH_AM(OP_ISC, cpu_execute_isc, 0x13, AM_INDIRECT_Y);
-        CHECK_INSTRUCTION_WITH_AM(OP_ISC, cpu_execute_isc, 0x17, AM_ZERO_PAGE_X);
-        CHECK_INSTRUCTION_WITH_AM(OP_ISC, cpu_execute_isc, 0x1b, AM_ABSOLUTE_Y);
-        CHECK_INSTRUCTION_WITH_AM(OP_ISC, cpu_execute_isc, 0x1f, AM_ABSOLUTE_X);
-    default:
-        printf("error: unknown instruction with code: 0x%x\n", instruction);
-        exit(1);
-    }
-}
-
-void cpu_sync(Cpu *cpu, uint16_t master_clock) {
-    while (!cpu_stopped(cpu) && cpu->internal_clock < master_clock) {
+    cpu->cycles += cpu_instruction_cycles[instruction];
+    cpu->instructions++;
+}
+
+void cpu_sync(Cpu *cpu, uint64_t master_clock) {
+    cpu->deadline = master_clock;
+
+    while (!cpu_stopped(cpu) && clock_is_before(cpu->cycles, cpu->deadline)) {
         cpu_execute_instruction(cpu);
+    }
+}
+
+void cpu_yield(Cpu *cpu) { cpu->deadline = cpu->cycles; }
+
+void cpu_save_state(Cpu *cpu, StateWriter *writer) {
+    state_write_u64(writer, cpu->cycles);
+    state_write_u64(writer, cpu->instructions);
+    state_write_u16(writer, cpu->instruction_pointer);
+    state_write_u8(writer, cpu->status);
+    state_write_u8(writer, cpu->stack_pointer);
+    state_write_u8(writer, cpu->accumulator);
+    state_write_u8(writer, cpu->register_x);
+    state_write_u8(writer, cpu->register_y);
+
+    state_write_bytes(writer, cpu->ram, CPU_RAM_SIZE);
+
+    if (cpu->mapper.save_state != NULL) {
+        cpu->mapper.save_state(cpu->mapper.context, writer);
+    }
+}
+
+void cpu_load_state(Cpu *cpu, StateReader *reader) {
+    cpu->cycles = state_read_u64(reader);
+    cpu->instructions = state_read_u64(reader);
+    cpu->instruction_pointer = state_read_u16(reader);
+    cpu->status = state_read_u8(reader);
+    cpu->stack_pointer = state_read_u8(reader);
+    cpu->accumulator = state_read_u8(reader);
+    cpu->register_x = state_read_u8(reader);
+    cpu->register_y = state_read_u8(reader);
+
+    state_read_bytes(reader, cpu->ram, CPU_RAM_SIZE);
+
+    if (cpu->mapper.load_state != NULL) {
+        cpu->mapper.load_state(cpu->mapper.context, reader);
+    }
+
+    cpu_invalidate_mapper(cpu);
+}
+
+#ifdef LOYD_PROFILE
+#define PROFILE_HOTTEST_POINTERS 32
+
+typedef struct {
+    uint32_t key;
+    uint64_t count;
+} ProfileEntry;
+
+static int compare_profile_entries(const void *a, const void *b) {
+    const ProfileEntry *lhs = a;
+    const ProfileEntry *rhs = b;
+
+    return (lhs->count < rhs->count) - (lhs->count > rhs->count);
+}
+
+// Reads memory without touching I/O registers, which could have side effects
+static uint8_t cpu_peek_byte(Cpu *cpu, uint16_t pointer) {
+    const uint8_t *memory = cpu->pages[pointer >> 8].read_memory;
+
+    return memory != NULL ? memory[pointer & 0xff] : 0;
+}
+
+void cpu_profile_dump(Cpu *cpu, FILE *file) {
+    CpuProfile *profile = &cpu->profile;
+
+    ProfileEntry opcodes[256];
+    uint64_t total = 0;
+
+    for (uint32_t i = 0; i < 256; i++) {
+        opcodes[i] = (ProfileEntry){.key = i, .count = profile->opcodes[i]};
+        total += profile->opcodes[i];
+    }
+
+    if (total == 0) {
+        fprintf(file, "profile: no instructions executed\n");
+
+        return;
+    }
+
+    qsort(opcodes, 256, sizeof(ProfileEntry), compare_profile_entries);
+
+    fprintf(file, "profile: %llu instructions\n\n", (unsigned long long)total);
+    fprintf(file, "opcode  instruction          count    share\n");
+
+    for (int i = 0; i < 256 && opcodes[i].count != 0; i++) {
+        fprintf(file, "  0x%02X  %s %-8s %14llu  %6.2f%%\n", opcodes[i].key, instruction_mnemonic(opcodes[i].key),
+                instruction_addressing_mode_name(opcodes[i].key), (unsigned long long)opcodes[i].count,
+                100.0 * opcodes[i].count / total);
+    }
+
+    // Only the hottest are printed, so they are kept in order while scanning instead of sorting all of them
+    ProfileEntry pointers[PROFILE_HOTTEST_POINTERS] = {0};
+
+    for (uint32_t i = 0; i < 0x10000; i++) {
+        uint64_t count = profile->instruction_pointers[i];
+        int j = PROFILE_HOTTEST_POINTERS;
+
+        while (j > 0 && pointers[j - 1].count < count) {
+            if (j < PROFILE_HOTTEST_POINTERS) {
+                pointers[j] = pointers[j - 1];
+            }
+
+            j--;
+        }
+
+        if (j < PROFILE_HOTTEST_POINTERS) {
+            pointers[j] = (ProfileEntry){.key = i, .count = count};
+        }
+    }
+
+    fprintf(file, "\nhottest instruction pointers\n");
+
+    for (int i = 0; i < PROFILE_HOTTEST_POINTERS && pointers[i].count != 0; i++) {
+        uint16_t pointer = pointers[i].key;
+        uint8_t bytes[3];
+
+        for (int j = 0; j < 3; j++) {
+            bytes[j] = cpu_peek_byte(cpu, pointer + j);
+        }
+
+        char disassembly[32];
+        disassemble(disassembly, sizeof(disassembly), pointer, bytes);
 
-        cpu->internal_clock++;
+        fprintf(file, "  $%04X  %-16s %14llu  %6.2f%%\n", pointer, disassembly,
+                (unsigned long long)pointers[i].count, 100.0 * pointers[i].count / total);
     }
 }
+#endif
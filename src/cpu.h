@@ -2,14 +2,86 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
+#include "arena.h"
+#include "clock.h"
+#include "fs.h"
+#include "ines.h"
 #include "mapper.h"
+#include "state.h"
 
-#define RAM_SIZE 0xFFFF
+// The 2 KiB of RAM inside the console, cartridge RAM belongs to the mapper
+#define CPU_RAM_SIZE 0x800
 
+typedef enum {
+    FAULT_NONE,
+    FAULT_IO,
+    FAULT_BAD_HEADER,
+    FAULT_UNSUPPORTED_MAPPER,
+    FAULT_ILLEGAL_OPCODE,
+    FAULT_OUT_OF_MEMORY,
+} FaultKind;
+
+// Why an emulator stopped on its own, kept per instance so one bad ROM does not affect any other
+typedef struct {
+    FaultKind kind;
+    uint16_t instruction_pointer;
+    uint8_t opcode;
+    char message[256];
+} Fault;
+
+#define CPU_PAGE_COUNT 256
+
+#ifdef LOYD_PROFILE
+// Execution counts collected by profiling builds
+typedef struct {
+    uint64_t opcodes[256];
+    uint64_t instruction_pointers[0x10000];
+} CpuProfile;
+#endif
+
+typedef struct Cpu Cpu;
+
+// How the CPU reaches the rest of the console, set up by the emulator
 typedef struct {
-    uint8_t ram[RAM_SIZE];
-    uint16_t internal_clock;
+    void *context;
+
+    // PPU registers at $2000-$3FFF and APU and I/O registers at $4000-$401F
+    uint8_t (*read)(void *context, uint16_t pointer);
+    void (*write)(void *context, uint16_t pointer, uint8_t byte);
+
+    // Called after the mapper switched banks, so whatever else caches them can follow
+    void (*mapper_invalidated)(void *context);
+
+    // Called around every write to the registers of a mapper with a scanline counter: before it to catch the
+    // counter up, after it to follow whatever the write changed about the IRQ
+    void (*mapper_sync)(void *context);
+    void (*mapper_written)(void *context);
+} CpuBus;
+
+typedef uint8_t (*CpuReadHandler)(Cpu *, uint16_t pointer);
+typedef void (*CpuWriteHandler)(Cpu *, uint16_t pointer, uint8_t byte);
+
+// A 256 byte page of the CPU address space. Pages backed by host memory are accessed directly through it,
+// the others (I/O and mapper registers) go through their handlers.
+typedef struct {
+    const uint8_t *read_memory;
+    uint8_t *write_memory;
+    CpuReadHandler read;
+    CpuWriteHandler write;
+} CpuPage;
+
+struct Cpu {
+    uint8_t ram[CPU_RAM_SIZE];
+    CpuPage pages[CPU_PAGE_COUNT];
+    uint64_t cycles;
+    // Where the running cpu_sync stops
+    uint64_t deadline;
+    // Level of the IRQ line, driven by the emulator
+    bool irq;
+    uint64_t instructions;
+    bool page_crossed;
     uint16_t instruction_pointer;
     uint8_t status;
     uint8_t stack_pointer;
@@ -17,7 +89,16 @@ typedef struct {
     uint8_t register_x;
     uint8_t register_y;
     Mapper mapper;
-} Cpu;
+    MapperDesription mapper_description;
+    FileContents rom;
+    InesHeader ines;
+    Fault fault;
+    CpuBus bus;
+#ifdef LOYD_PROFILE
+    // Part of the emulator rather than allocated on the side, so it comes and goes with the instance
+    CpuProfile profile;
+#endif
+};
 
 typedef enum {
     AM_IMPLICIT,
@@ -65,6 +146,7 @@ typedef enum {
     OP_BNE = 0xD0,
     OP_BEQ = 0xF0,
     OP_RTS = 0x60,
+    OP_RTI = 0x40,
     OP_ASL = 0x00,
     OP_ROL = 0x20,
     OP_ROR = 0x60,
@@ -100,6 +182,23 @@ typedef enum {
 } OpCode;
 
 void cpu_power_on(Cpu *);
-void cpu_load_rom(Cpu *, const char *path);
-void cpu_sync(Cpu *, uint16_t master_clock);
+// The ROM and everything the mapper needs are allocated from the arena, which is left as it was on failure
+bool cpu_load_rom(Cpu *, Arena *, const char *path);
+void cpu_unload_rom(Cpu *);
+uint8_t cpu_read(Cpu *, uint16_t pointer);
+void cpu_nmi(Cpu *);
+// Takes the IRQ unless interrupts are disabled, the emulator calls it again while the line stays asserted
+void cpu_irq(Cpu *);
+void cpu_sync(Cpu *, uint64_t master_clock);
+// Ends the running cpu_sync after the current instruction, so the caller can react to an event raised by it
+void cpu_yield(Cpu *);
 bool cpu_stopped(Cpu *);
+
+// Registers, the internal RAM and the mapper. Loading rebuilds the page table and invalidates the mapper.
+void cpu_save_state(Cpu *, StateWriter *);
+void cpu_load_state(Cpu *, StateReader *);
+
+#ifdef LOYD_PROFILE
+// Prints the opcode histogram and the hottest instruction pointers, disassembled
+void cpu_profile_dump(Cpu *, FILE *);
+#endif
@@ -0,0 +1,362 @@
+#include <stdio.h>
+
+#include "disassembler.h"
+
+typedef struct {
+    const char *mnemonic;
+    AddressingMode addressing_mode;
+} InstructionInfo;
+
+// Every opcode including the unofficial ones, named the way most 6502 references do
+static const InstructionInfo instruction_infos[256] = {
+    [0x00] = {"BRK", AM_IMPLICIT},
+    [0x01] = {"ORA", AM_INDIRECT_X},
+    [0x02] = {"STP", AM_IMPLICIT},
+    [0x03] = {"SLO", AM_INDIRECT_X},
+    [0x04] = {"NOP", AM_ZERO_PAGE},
+    [0x05] = {"ORA", AM_ZERO_PAGE},
+    [0x06] = {"ASL", AM_ZERO_PAGE},
+    [0x07] = {"SLO", AM_ZERO_PAGE},
+    [0x08] = {"PHP", AM_IMPLICIT},
+    [0x09] = {"ORA", AM_IMMEDIATE},
+    [0x0A] = {"ASL", AM_ACCUMULATOR},
+    [0x0B] = {"ANC", AM_IMMEDIATE},
+    [0x0C] = {"NOP", AM_ABSOLUTE},
+    [0x0D] = {"ORA", AM_ABSOLUTE},
+    [0x0E] = {"ASL", AM_ABSOLUTE},
+    [0x0F] = {"SLO", AM_ABSOLUTE},
+    [0x10] = {"BPL", AM_RELATIVE},
+    [0x11] = {"ORA", AM_INDIRECT_Y},
+    [0x12] = {"STP", AM_IMPLICIT},
+    [0x13] = {"SLO", AM_INDIRECT_Y},
+    [0x14] = {"NOP", AM_ZERO_PAGE_X},
+    [0x15] = {"ORA", AM_ZERO_PAGE_X},
+    [0x16] = {"ASL", AM_ZERO_PAGE_X},
+    [0x17] = {"SLO", AM_ZERO_PAGE_X},
+    [0x18] = {"CLC", AM_IMPLICIT},
+    [0x19] = {"ORA", AM_ABSOLUTE_Y},
+    [0x1A] = {"NOP", AM_IMPLICIT},
+    [0x1B] = {"SLO", AM_ABSOLUTE_Y},
+    [0x1C] = {"NOP", AM_ABSOLUTE_X},
+    [0x1D] = {"ORA", AM_ABSOLUTE_X},
+    [0x1E] = {"ASL", AM_ABSOLUTE_X},
+    [0x1F] = {"SLO", AM_ABSOLUTE_X},
+    [0x20] = {"JSR", AM_ABSOLUTE},
+    [0x21] = {"AND", AM_INDIRECT_X},
+    [0x22] = {"STP", AM_IMPLICIT},
+    [0x23] = {"RLA", AM_INDIRECT_X},
+    [0x24] = {"BIT", AM_ZERO_PAGE},
+    [0x25] = {"AND", AM_ZERO_PAGE},
+    [0x26] = {"ROL", AM_ZERO_PAGE},
+    [0x27] = {"RLA", AM_ZERO_PAGE},
+    [0x28] = {"PLP", AM_IMPLICIT},
+    [0x29] = {"AND", AM_IMMEDIATE},
+    [0x2A] = {"ROL", AM_ACCUMULATOR},
+    [0x2B] = {"ANC", AM_IMMEDIATE},
+    [0x2C] = {"BIT", AM_ABSOLUTE},
+    [0x2D] = {"AND", AM_ABSOLUTE},
+    [0x2E] = {"ROL", AM_ABSOLUTE},
+    [0x2F] = {"RLA", AM_ABSOLUTE},
+    [0x30] = {"BMI", AM_RELATIVE},
+    [0x31] = {"AND", AM_INDIRECT_Y},
+    [0x32] = {"STP", AM_IMPLICIT},
+    [0x33] = {"RLA", AM_INDIRECT_Y},
+    [0x34] = {"NOP", AM_ZERO_PAGE_X},
+    [0x35] = {"AND", AM_ZERO_PAGE_X},
+    [0x36] = {"ROL", AM_ZERO_PAGE_X},
+    [0x37] = {"RLA", AM_ZERO_PAGE_X},
+    [0x38] = {"SEC", AM_IMPLICIT},
+    [0x39] = {"AND", AM_ABSOLUTE_Y},
+    [0x3A] = {"NOP", AM_IMPLICIT},
+    [0x3B] = {"RLA", AM_ABSOLUTE_Y},
+    [0x3C] = {"NOP", AM_ABSOLUTE_X},
+    [0x3D] = {"AND", AM_ABSOLUTE_X},
+    [0x3E] = {"ROL", AM_ABSOLUTE_X},
+    [0x3F] = {"RLA", AM_ABSOLUTE_X},
+    [0x40] = {"RTI", AM_IMPLICIT},
+    [0x41] = {"EOR", AM_INDIRECT_X},
+    [0x42] = {"STP", AM_IMPLICIT},
+    [0x43] = {"SRE", AM_INDIRECT_X},
+    [0x44] = {"NOP", AM_ZERO_PAGE},
+    [0x45] = {"EOR", AM_ZERO_PAGE},
+    [0x46] = {"LSR", AM_ZERO_PAGE},
+    [0x47] = {"SRE", AM_ZERO_PAGE},
+    [0x48] = {"PHA", AM_IMPLICIT},
+    [0x49] = {"EOR", AM_IMMEDIATE},
+    [0x4A] = {"LSR", AM_ACCUMULATOR},
+    [0x4B] = {"ALR", AM_IMMEDIATE},
+    [0x4C] = {"JMP", AM_ABSOLUTE},
+    [0x4D] = {"EOR", AM_ABSOLUTE},
+    [0x4E] = {"LSR", AM_ABSOLUTE},
+    [0x4F] = {"SRE", AM_ABSOLUTE},
+    [0x50] = {"BVC", AM_RELATIVE},
+    [0x51] = {"EOR", AM_INDIRECT_Y},
+    [0x52] = {"STP", AM_IMPLICIT},
+    [0x53] = {"SRE", AM_INDIRECT_Y},
+    [0x54] = {"NOP", AM_ZERO_PAGE_X},
+    [0x55] = {"EOR", AM_ZERO_PAGE_X},
+    [0x56] = {"LSR", AM_ZERO_PAGE_X},
+    [0x57] = {"SRE", AM_ZERO_PAGE_X},
+    [0x58] = {"CLI", AM_IMPLICIT},
+    [0x59] = {"EOR", AM_ABSOLUTE_Y},
+    [0x5A] = {"NOP", AM_IMPLICIT},
+    [0x5B] = {"SRE", AM_ABSOLUTE_Y},
+    [0x5C] = {"NOP", AM_ABSOLUTE_X},
+    [0x5D] = {"EOR", AM_ABSOLUTE_X},
+    [0x5E] = {"LSR", AM_ABSOLUTE_X},
+    [0x5F] = {"SRE", AM_ABSOLUTE_X},
+    [0x60] = {"RTS", AM_IMPLICIT},
+    [0x61] = {"ADC", AM_INDIRECT_X},
+    [0x62] = {"STP", AM_IMPLICIT},
+    [0x63] = {"RRA", AM_INDIRECT_X},
+    [0x64] = {"NOP", AM_ZERO_PAGE},
+    [0x65] = {"ADC", AM_ZERO_PAGE},
+    [0x66] = {"ROR", AM_ZERO_PAGE},
+    [0x67] = {"RRA", AM_ZERO_PAGE},
+    [0x68] = {"PLA", AM_IMPLICIT},
+    [0x69] = {"ADC", AM_IMMEDIATE},
+    [0x6A] = {"ROR", AM_ACCUMULATOR},
+    [0x6B] = {"ARR", AM_IMMEDIATE},
+    [0x6C] = {"JMP", AM_INDIRECT_JMP},
+    [0x6D] = {"ADC", AM_ABSOLUTE},
+    [0x6E] = {"ROR", AM_ABSOLUTE},
+    [0x6F] = {"RRA", AM_ABSOLUTE},
+    [0x70] = {"BVS", AM_RELATIVE},
+    [0x71] = {"ADC", AM_INDIRECT_Y},
+    [0x72] = {"STP", AM_IMPLICIT},
+    [0x73] = {"RRA", AM_INDIRECT_Y},
+    [0x74] = {"NOP", AM_ZERO_PAGE_X},
+    [0x75] = {"ADC", AM_ZERO_PAGE_X},
+    [0x76] = {"ROR", AM_ZERO_PAGE_X},
+    [0x77] = {"RRA", AM_ZERO_PAGE_X},
+    [0x78] = {"SEI", AM_IMPLICIT},
+    [0x79] = {"ADC", AM_ABSOLUTE_Y},
+    [0x7A] = {"NOP", AM_IMPLICIT},
+    [0x7B] = {"RRA", AM_ABSOLUTE_Y},
+    [0x7C] = {"NOP", AM_ABSOLUTE_X},
+    [0x7D] = {"ADC", AM_ABSOLUTE_X},
+    [0x7E] = {"ROR", AM_ABSOLUTE_X},
+    [0x7F] = {"RRA", AM_ABSOLUTE_X},
+    [0x80] = {"NOP", AM_IMMEDIATE},
+    [0x81] = {"STA", AM_INDIRECT_X},
+    [0x82] = {"NOP", AM_IMMEDIATE},
+    [0x83] = {"SAX", AM_INDIRECT_X},
+    [0x84] = {"STY", AM_ZERO_PAGE},
+    [0x85] = {"STA", AM_ZERO_PAGE},
+    [0x86] = {"STX", AM_ZERO_PAGE},
+    [0x87] = {"SAX", AM_ZERO_PAGE},
+    [0x88] = {"DEY", AM_IMPLICIT},
+    [0x89] = {"NOP", AM_IMMEDIATE},
+    [0x8A] = {"TXA", AM_IMPLICIT},
+    [0x8B] = {"XAA", AM_IMMEDIATE},
+    [0x8C] = {"STY", AM_ABSOLUTE},
+    [0x8D] = {"STA", AM_ABSOLUTE},
+    [0x8E] = {"STX", AM_ABSOLUTE},
+    [0x8F] = {"SAX", AM_ABSOLUTE},
+    [0x90] = {"BCC", AM_RELATIVE},
+    [0x91] = {"STA", AM_INDIRECT_Y},
+    [0x92] = {"STP", AM_IMPLICIT},
+    [0x93] = {"AHX", AM_INDIRECT_Y},
+    [0x94] = {"STY", AM_ZERO_PAGE_X},
+    [0x95] = {"STA", AM_ZERO_PAGE_X},
+    [0x96] = {"STX", AM_ZERO_PAGE_Y},
+    [0x97] = {"SAX", AM_ZERO_PAGE_Y},
+    [0x98] = {"TYA", AM_IMPLICIT},
+    [0x99] = {"STA", AM_ABSOLUTE_Y},
+    [0x9A] = {"TXS", AM_IMPLICIT},
+    [0x9B] = {"TAS", AM_ABSOLUTE_Y},
+    [0x9C] = {"SHY", AM_ABSOLUTE_X},
+    [0x9D] = {"STA", AM_ABSOLUTE_X},
+    [0x9E] = {"SHX", AM_ABSOLUTE_Y},
+    [0x9F] = {"AHX", AM_ABSOLUTE_Y},
+    [0xA0] = {"LDY", AM_IMMEDIATE},
+    [0xA1] = {"LDA", AM_INDIRECT_X},
+    [0xA2] = {"LDX", AM_IMMEDIATE},
+    [0xA3] = {"LAX", AM_INDIRECT_X},
+    [0xA4] = {"LDY", AM_ZERO_PAGE},
+    [0xA5] = {"LDA", AM_ZERO_PAGE},
+    [0xA6] = {"LDX", AM_ZERO_PAGE},
+    [0xA7] = {"LAX", AM_ZERO_PAGE},
+    [0xA8] = {"TAY", AM_IMPLICIT},
+    [0xA9] = {"LDA", AM_IMMEDIATE},
+    [0xAA] = {"TAX", AM_IMPLICIT},
+    [0xAB] = {"LAX", AM_IMMEDIATE},
+    [0xAC] = {"LDY", AM_ABSOLUTE},
+    [0xAD] = {"LDA", AM_ABSOLUTE},
+    [0xAE] = {"LDX", AM_ABSOLUTE},
+    [0xAF] = {"LAX", AM_ABSOLUTE},
+    [0xB0] = {"BCS", AM_RELATIVE},
+    [0xB1] = {"LDA", AM_INDIRECT_Y},
+    [0xB2] = {"STP", AM_IMPLICIT},
+    [0xB3] = {"LAX", AM_INDIRECT_Y},
+    [0xB4] = {"LDY", AM_ZERO_PAGE_X},
+    [0xB5] = {"LDA", AM_ZERO_PAGE_X},
+    [0xB6] = {"LDX", AM_ZERO_PAGE_Y},
+    [0xB7] = {"LAX", AM_ZERO_PAGE_Y},
+    [0xB8] = {"CLV", AM_IMPLICIT},
+    [0xB9] = {"LDA", AM_ABSOLUTE_Y},
+    [0xBA] = {"TSX", AM_IMPLICIT},
+    [0xBB] = {"LAS", AM_ABSOLUTE_Y},
+    [0xBC] = {"LDY", AM_ABSOLUTE_X},
+    [0xBD] = {"LDA", AM_ABSOLUTE_X},
+    [0xBE] = {"LDX", AM_ABSOLUTE_Y},
+    [0xBF] = {"LAX", AM_ABSOLUTE_Y},
+    [0xC0] = {"CPY", AM_IMMEDIATE},
+    [0xC1] = {"CMP", AM_INDIRECT_X},
+    [0xC2] = {"NOP", AM_IMMEDIATE},
+    [0xC3] = {"DCP", AM_INDIRECT_X},
+    [0xC4] = {"CPY", AM_ZERO_PAGE},
+    [0xC5] = {"CMP", AM_ZERO_PAGE},
+    [0xC6] = {"DEC", AM_ZERO_PAGE},
+    [0xC7] = {"DCP", AM_ZERO_PAGE},
+    [0xC8] = {"INY", AM_IMPLICIT},
+    [0xC9] = {"CMP", AM_IMMEDIATE},
+    [0xCA] = {"DEX", AM_IMPLICIT},
+    [0xCB] = {"AXS", AM_IMMEDIATE},
+    [0xCC] = {"CPY", AM_ABSOLUTE},
+    [0xCD] = {"CMP", AM_ABSOLUTE},
+    [0xCE] = {"DEC", AM_ABSOLUTE},
+    [0xCF] = {"DCP", AM_ABSOLUTE},
+    [0xD0] = {"BNE", AM_RELATIVE},
+    [0xD1] = {"CMP", AM_INDIRECT_Y},
+    [0xD2] = {"STP", AM_IMPLICIT},
+    [0xD3] = {"DCP", AM_INDIRECT_Y},
+    [0xD4] = {"NOP", AM_ZERO_PAGE_X},
+    [0xD5] = {"CMP", AM_ZERO_PAGE_X},
+    [0xD6] = {"DEC", AM_ZERO_PAGE_X},
+    [0xD7] = {"DCP", AM_ZERO_PAGE_X},
+    [0xD8] = {"CLD", AM_IMPLICIT},
+    [0xD9] = {"CMP", AM_ABSOLUTE_Y},
+    [0xDA] = {"NOP", AM_IMPLICIT},
+    [0xDB] = {"DCP", AM_ABSOLUTE_Y},
+    [0xDC] = {"NOP", AM_ABSOLUTE_X},
+    [0xDD] = {"CMP", AM_ABSOLUTE_X},
+    [0xDE] = {"DEC", AM_ABSOLUTE_X},
+    [0xDF] = {"DCP", AM_ABSOLUTE_X},
+    [0xE0] = {"CPX", AM_IMMEDIATE},
+    [0xE1] = {"SBC", AM_INDIRECT_X},
+    [0xE2] = {"NOP", AM_IMMEDIATE},
+    [0xE3] = {"ISC", AM_INDIRECT_X},
+    [0xE4] = {"CPX", AM_ZERO_PAGE},
+    [0xE5] = {"SBC", AM_ZERO_PAGE},
+    [0xE6] = {"INC", AM_ZERO_PAGE},
+    [0xE7] = {"ISC", AM_ZERO_PAGE},
+    [0xE8] = {"INX", AM_IMPLICIT},
+    [0xE9] = {"SBC", AM_IMMEDIATE},
+    [0xEA] = {"NOP", AM_IMPLICIT},
+    [0xEB] = {"SBC", AM_IMMEDIATE},
+    [0xEC] = {"CPX", AM_ABSOLUTE},
+    [0xED] = {"SBC", AM_ABSOLUTE},
+    [0xEE] = {"INC", AM_ABSOLUTE},
+    [0xEF] = {"ISC", AM_ABSOLUTE},
+    [0xF0] = {"BEQ", AM_RELATIVE},
+    [0xF1] = {"SBC", AM_INDIRECT_Y},
+    [0xF2] = {"STP", AM_IMPLICIT},
+    [0xF3] = {"ISC", AM_INDIRECT_Y},
+    [0xF4] = {"NOP", AM_ZERO_PAGE_X},
+    [0xF5] = {"SBC", AM_ZERO_PAGE_X},
+    [0xF6] = {"INC", AM_ZERO_PAGE_X},
+    [0xF7] = {"ISC", AM_ZERO_PAGE_X},
+    [0xF8] = {"SED", AM_IMPLICIT},
+    [0xF9] = {"SBC", AM_ABSOLUTE_Y},
+    [0xFA] = {"NOP", AM_IMPLICIT},
+    [0xFB] = {"ISC", AM_ABSOLUTE_Y},
+    [0xFC] = {"NOP", AM_ABSOLUTE_X},
+    [0xFD] = {"SBC", AM_ABSOLUTE_X},
+    [0xFE] = {"INC", AM_ABSOLUTE_X},
+    [0xFF] = {"ISC", AM_ABSOLUTE_X},
+};
+
+static const char *addressing_mode_names[] = {
+    [AM_IMPLICIT] = "",
+    [AM_ACCUMULATOR] = "A",
+    [AM_RELATIVE] = "rel",
+    [AM_IMMEDIATE] = "#imm",
+    [AM_ABSOLUTE] = "abs",
+    [AM_ABSOLUTE_X] = "abs,X",
+    [AM_ABSOLUTE_Y] = "abs,Y",
+    [AM_ZERO_PAGE] = "zp",
+    [AM_ZERO_PAGE_X] = "zp,X",
+    [AM_ZERO_PAGE_Y] = "zp,Y",
+    [AM_INDIRECT_JMP] = "(abs)",
+    [AM_INDIRECT_X] = "(zp,X)",
+    [AM_INDIRECT_Y] = "(zp),Y",
+};
+
+const char *instruction_mnemonic(uint8_t opcode) { return instruction_infos[opcode].mnemonic; }
+
+const char *instruction_addressing_mode_name(uint8_t opcode) {
+    return addressing_mode_names[instruction_infos[opcode].addressing_mode];
+}
+
+uint8_t instruction_size(uint8_t opcode) {
+    switch (instruction_infos[opcode].addressing_mode) {
+    case AM_IMPLICIT:
+    case AM_ACCUMULATOR:
+        return 1;
+    case AM_RELATIVE:
+    case AM_IMMEDIATE:
+    case AM_ZERO_PAGE:
+    case AM_ZERO_PAGE_X:
+    case AM_ZERO_PAGE_Y:
+    case AM_INDIRECT_X:
+    case AM_INDIRECT_Y:
+        return 2;
+    case AM_ABSOLUTE:
+    case AM_ABSOLUTE_X:
+    case AM_ABSOLUTE_Y:
+    case AM_INDIRECT_JMP:
+        return 3;
+    }
+
+    return 1;
+}
+
+void disassemble(char *buffer, size_t size, uint16_t pointer, const uint8_t *bytes) {
+    const InstructionInfo *info = &instruction_infos[bytes[0]];
+
+    uint8_t byte = bytes[1];
+    uint16_t word = bytes[1] | (bytes[2] << 8);
+
+    switch (info->addressing_mode) {
+    case AM_IMPLICIT:
+        snprintf(buffer, size, "%s", info->mnemonic);
+        break;
+    case AM_ACCUMULATOR:
+        snprintf(buffer, size, "%s A", info->mnemonic);
+        break;
+    case AM_RELATIVE:
+        snprintf(buffer, size, "%s $%04X", info->mnemonic, (uint16_t)(pointer + 2 + (int8_t)byte));
+        break;
+    case AM_IMMEDIATE:
+        snprintf(buffer, size, "%s #$%02X", info->mnemonic, byte);
+        break;
+    case AM_ABSOLUTE:
+        snprintf(buffer, size, "%s $%04X", info->mnemonic, word);
+        break;
+    case AM_ABSOLUTE_X:
+        snprintf(buffer, size, "%s $%04X,X", info->mnemonic, word);
+        break;
+    case AM_ABSOLUTE_Y:
+        snprintf(buffer, size, "%s $%04X,Y", info->mnemonic, word);
+        break;
+    case AM_ZERO_PAGE:
+        snprintf(buffer, size, "%s $%02X", info->mnemonic, byte);
+        break;
+    case AM_ZERO_PAGE_X:
+        snprintf(buffer, size, "%s $%02X,X", info->mnemonic, byte);
+        break;
+    case AM_ZERO_PAGE_Y:
+        snprintf(buffer, size, "%s $%02X,Y", info->mnemonic, byte);
+        break;
+    case AM_INDIRECT_JMP:
+        snprintf(buffer, size, "%s ($%04X)", info->mnemonic, word);
+        break;
+    case AM_INDIRECT_X:
+        snprintf(buffer, size, "%s ($%02X,X)", info->mnemonic, byte);
+        break;
+    case AM_INDIRECT_Y:
+        snprintf(buffer, size, "%s ($%02X),Y", info->mnemonic, byte);
+        break;
+    }
+}
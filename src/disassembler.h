@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+const char *instruction_mnemonic(uint8_t opcode);
+const char *instruction_addressing_mode_name(uint8_t opcode);
+uint8_t instruction_size(uint8_t opcode);
+
+// Formats the instruction starting at bytes, which has to hold instruction_size bytes, as assembly
+void disassemble(char *buffer, size_t size, uint16_t pointer, const uint8_t *bytes);
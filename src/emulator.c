@@ -1,24 +1,483 @@
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 
+#include "apu.h"
+#include "audio.h"
 #include "cpu.h"
 #include "emulator.h"
+#include "ppu.h"
+#include "state.h"
+
+static void scheduler_swap(Scheduler *scheduler, int i, int j) {
+    Event event = scheduler->events[i];
+    scheduler->events[i] = scheduler->events[j];
+    scheduler->events[j] = event;
+}
+
+static bool scheduler_is_before(Scheduler *scheduler, int i, int j) {
+    return clock_is_before(scheduler->events[i].deadline, scheduler->events[j].deadline);
+}
+
+static void scheduler_sift_up(Scheduler *scheduler, int i) {
+    while (i > 0 && scheduler_is_before(scheduler, i, (i - 1) / 2)) {
+        scheduler_swap(scheduler, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void scheduler_sift_down(Scheduler *scheduler, int i) {
+    while (true) {
+        int smallest = i;
+
+        for (int child = 2 * i + 1; child <= 2 * i + 2 && child < scheduler->count; child++) {
+            if (scheduler_is_before(scheduler, child, smallest)) {
+                smallest = child;
+            }
+        }
+
+        if (smallest == i) {
+            return;
+        }
+
+        scheduler_swap(scheduler, i, smallest);
+        i = smallest;
+    }
+}
+
+static void scheduler_remove_at(Scheduler *scheduler, int i) {
+    scheduler->events[i] = scheduler->events[--scheduler->count];
+
+    if (i < scheduler->count) {
+        scheduler_sift_up(scheduler, i);
+        scheduler_sift_down(scheduler, i);
+    }
+}
+
+static void scheduler_cancel(Scheduler *scheduler, EventKind kind) {
+    for (int i = 0; i < scheduler->count; i++) {
+        if (scheduler->events[i].kind == kind) {
+            scheduler_remove_at(scheduler, i);
+            return;
+        }
+    }
+}
+
+// Replaces the pending event of the same kind, if there is one
+static void scheduler_schedule(Scheduler *scheduler, EventKind kind, uint64_t deadline) {
+    scheduler_cancel(scheduler, kind);
+
+    scheduler->events[scheduler->count] = (Event){.deadline = deadline, .kind = kind};
+    scheduler_sift_up(scheduler, scheduler->count++);
+}
+
+// Catches the APU up with the CPU, which then pays for the cycles the DMC took from it
+static void emulator_sync_apu(Emulator *emulator) {
+    Cpu *cpu = &emulator->cpu;
+    Apu *apu = &emulator->apu;
+
+    apu_sync(apu, cpu->cycles);
+
+    cpu->cycles += apu->stall;
+    apu->stall = 0;
+}
+
+// The IRQ line is shared by the APU and the mapper
+static void emulator_update_irq(Emulator *emulator) {
+    Cpu *cpu = &emulator->cpu;
+
+    cpu->irq = apu_irq(&emulator->apu) || (cpu->mapper.irq != NULL && cpu->mapper.irq(cpu->mapper.context));
+
+    if (cpu->irq) {
+        cpu_yield(cpu);
+    }
+}
+
+// Follows a change of the APU: its events move and its IRQ line may have changed
+static void emulator_apu_changed(Emulator *emulator) {
+    Apu *apu = &emulator->apu;
+    uint64_t fetch;
+
+    scheduler_schedule(&emulator->scheduler, EVENT_APU_FRAME, apu_next_frame_step(apu));
+
+    if (apu_next_dmc_fetch(apu, &fetch)) {
+        scheduler_schedule(&emulator->scheduler, EVENT_DMC, fetch);
+    } else {
+        scheduler_cancel(&emulator->scheduler, EVENT_DMC);
+    }
+
+    emulator_update_irq(emulator);
+}
+
+// Hands the scanlines the PPU has counted up to the CPU over to the mapper
+static void emulator_sync_mapper(Emulator *emulator) {
+    Mapper *mapper = &emulator->cpu.mapper;
+
+    if (mapper->clock_scanlines == NULL) {
+        return;
+    }
+
+    ppu_sync(&emulator->ppu, emulator->cpu.cycles);
+
+    mapper->clock_scanlines(mapper->context, emulator->ppu.scanline_clocks - emulator->mapper_scanline_clocks);
+    emulator->mapper_scanline_clocks = emulator->ppu.scanline_clocks;
+}
+
+// Follows a change of the mapper's scanline counter or of how the PPU clocks it: the IRQ deadline moves and the
+// IRQ line may have changed
+static void emulator_mapper_changed(Emulator *emulator) {
+    Mapper *mapper = &emulator->cpu.mapper;
+    uint64_t deadline;
+
+    if (mapper->clock_scanlines == NULL) {
+        return;
+    }
+
+    emulator_sync_mapper(emulator);
+
+    uint32_t count = mapper->scanlines_until_irq(mapper->context);
+
+    if (count > 0 && ppu_next_scanline_clocks(&emulator->ppu, count, &deadline)) {
+        scheduler_schedule(&emulator->scheduler, EVENT_MAPPER_IRQ, deadline);
+    } else {
+        scheduler_cancel(&emulator->scheduler, EVENT_MAPPER_IRQ);
+    }
+
+    emulator_update_irq(emulator);
+}
+
+static uint8_t emulator_read_io(void *context, uint16_t pointer) {
+    Emulator *emulator = context;
+
+    if (pointer < 0x4000) {
+        ppu_sync(&emulator->ppu, emulator->cpu.cycles);
+
+        return ppu_read_register(&emulator->ppu, pointer);
+    }
+
+    if (pointer == 0x4015) {
+        emulator_sync_apu(emulator);
+
+        uint8_t status = apu_read_status(&emulator->apu);
+
+        emulator_apu_changed(emulator);
+
+        return status;
+    }
+
+    // Controllers
+    return 0;
+}
+
+static uint8_t emulator_read_dmc(void *context, uint16_t pointer) {
+    Emulator *emulator = context;
+
+    return cpu_read(&emulator->cpu, pointer);
+}
+
+// Copies a page of CPU memory into OAM, stalling the CPU while it does
+static void emulator_oam_dma(Emulator *emulator, uint8_t page) {
+    Cpu *cpu = &emulator->cpu;
+
+    for (int i = 0; i < 256; i++) {
+        ppu_write_register(&emulator->ppu, 0x2004, cpu_read(cpu, (page << 8) | i));
+    }
+
+    cpu->cycles += 513 + (cpu->cycles & 1);
+}
+
+static void emulator_write_io(void *context, uint16_t pointer, uint8_t byte) {
+    Emulator *emulator = context;
+
+    if (pointer < 0x4000) {
+        ppu_sync(&emulator->ppu, emulator->cpu.cycles);
+        ppu_write_register(&emulator->ppu, pointer, byte);
+
+        // Enabling NMIs during vertical blank raises one right away
+        if (emulator->ppu.nmi) {
+            cpu_yield(&emulator->cpu);
+        }
+
+        // Rendering and the pattern tables decide when the scanline counter is clocked
+        if ((pointer & 7) <= 1) {
+            emulator_mapper_changed(emulator);
+        }
+    } else if (pointer == 0x4014) {
+        ppu_sync(&emulator->ppu, emulator->cpu.cycles);
+        emulator_oam_dma(emulator, byte);
+    } else if (pointer <= 0x4013 || pointer == 0x4015 || pointer == 0x4017) {
+        emulator_sync_apu(emulator);
+        apu_write_register(&emulator->apu, pointer, byte);
+        emulator_apu_changed(emulator);
+    }
+}
+
+static void emulator_mapper_invalidated(void *context) {
+    Emulator *emulator = context;
+
+    // Lines up to now were drawn with the old banks
+    ppu_sync(&emulator->ppu, emulator->cpu.cycles);
+    ppu_map_mapper(&emulator->ppu, &emulator->cpu.mapper, &emulator->cpu.mapper_description);
+}
+
+static void emulator_mapper_sync(void *context) { emulator_sync_mapper(context); }
+
+static void emulator_mapper_written(void *context) { emulator_mapper_changed(context); }
 
 void emulator_power_on(Emulator *emulator) {
     emulator->master_clock = 0;
+    emulator->mapper_scanline_clocks = 0;
+    emulator->scheduler.count = 0;
 
     cpu_power_on(&emulator->cpu);
+    ppu_power_on(&emulator->ppu);
+
+    emulator->apu.context = emulator;
+    emulator->apu.read = emulator_read_dmc;
+    apu_power_on(&emulator->apu);
+
+    scheduler_schedule(&emulator->scheduler, EVENT_VBLANK, ppu_next_vblank(&emulator->ppu));
+    emulator_apu_changed(emulator);
+
+    emulator->cpu.bus = (CpuBus){
+        .context = emulator,
+        .read = emulator_read_io,
+        .write = emulator_write_io,
+        .mapper_invalidated = emulator_mapper_invalidated,
+        .mapper_sync = emulator_mapper_sync,
+        .mapper_written = emulator_mapper_written,
+    };
+}
+
+Emulator *emulator_create(Arena *arena) {
+    Emulator *emulator = arena_alloc(arena, sizeof(Emulator));
+
+    if (emulator == NULL) {
+        return NULL;
+    }
+
+    memset(emulator, 0, sizeof(Emulator));
+    emulator->arena = arena;
+
+    emulator_power_on(emulator);
+
+    return emulator;
 }
 
-void emulator_load_rom(Emulator *emulator, const char *rom_path) {
-    cpu_load_rom(&emulator->cpu, rom_path);
+void emulator_destroy(Emulator *emulator) {
+    emulator_unload_rom(emulator);
+
+    if (emulator->owned_arena.memory != NULL) {
+        munmap(emulator->owned_arena.memory, EMULATOR_ARENA_SIZE);
+        emulator->owned_arena = (Arena){0};
+        emulator->arena = NULL;
+    }
+}
+
+bool emulator_load_rom(Emulator *emulator, const char *rom_path) {
+    if (emulator->arena == NULL) {
+        // Only address space is reserved, pages take memory once the mapper or a piped ROM writes to them
+        void *memory = mmap(NULL, EMULATOR_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        if (memory == MAP_FAILED) {
+            emulator->cpu.fault = (Fault){.kind = FAULT_OUT_OF_MEMORY};
+            snprintf(emulator->cpu.fault.message, sizeof(emulator->cpu.fault.message),
+                     "could not allocate the arena for '%s'", rom_path);
+
+            return false;
+        }
+
+        arena_init(&emulator->owned_arena, memory, EMULATOR_ARENA_SIZE);
+        emulator->arena = &emulator->owned_arena;
+    }
+
+    emulator->rom_mark = arena_mark(emulator->arena);
+    emulator->rom_hashed = false;
+
+    return cpu_load_rom(&emulator->cpu, emulator->arena, rom_path);
+}
+
+void emulator_unload_rom(Emulator *emulator) {
+    cpu_unload_rom(&emulator->cpu);
+
+    if (emulator->arena != NULL) {
+        arena_rewind(emulator->arena, emulator->rom_mark);
+    }
 }
 
 bool emulator_stopped(Emulator *emulator) {
     return cpu_stopped(&emulator->cpu);
 }
 
-void emulator_step(Emulator *emulator, uint16_t steps) {
-    emulator->master_clock += steps;
+static void emulator_handle_event(Emulator *emulator, EventKind kind) {
+    switch (kind) {
+    case EVENT_VBLANK:
+        ppu_sync(&emulator->ppu, emulator->cpu.cycles);
+        scheduler_schedule(&emulator->scheduler, EVENT_VBLANK, ppu_next_vblank(&emulator->ppu));
+
+        // Audio is resampled a whole video frame at a time
+        emulator_sync_apu(emulator);
+        apu_end_frame(&emulator->apu);
+        emulator_apu_changed(emulator);
+        break;
+
+    case EVENT_APU_FRAME:
+    case EVENT_DMC:
+        emulator_sync_apu(emulator);
+        emulator_apu_changed(emulator);
+        break;
+
+    case EVENT_MAPPER_IRQ:
+        emulator_mapper_changed(emulator);
+        break;
+
+    case EVENT_KIND_COUNT:
+        break;
+    }
+}
+
+FaultKind emulator_step(Emulator *emulator, uint64_t cycles) {
+    Cpu *cpu = &emulator->cpu;
+    Ppu *ppu = &emulator->ppu;
+    Scheduler *scheduler = &emulator->scheduler;
+
+    emulator->master_clock += cycles;
+
+    // The CPU runs in straight bursts up to the next event, everything else catches up when the CPU touches it
+    // or when its event is due
+    while (!cpu_stopped(cpu) && clock_is_before(cpu->cycles, emulator->master_clock)) {
+        uint64_t deadline = emulator->master_clock;
+
+        if (scheduler->count > 0 && clock_is_before(scheduler->events[0].deadline, deadline)) {
+            deadline = scheduler->events[0].deadline;
+        }
+
+        cpu_sync(cpu, deadline);
+
+        while (scheduler->count > 0 && !clock_is_before(cpu->cycles, scheduler->events[0].deadline)) {
+            EventKind kind = scheduler->events[0].kind;
+
+            scheduler_remove_at(scheduler, 0);
+            emulator_handle_event(emulator, kind);
+        }
+
+        // Either from vertical blank or from a $2000 write that cut the burst short
+        if (ppu->nmi) {
+            ppu->nmi = false;
+            cpu_nmi(cpu);
+        }
+
+        if (cpu->irq) {
+            cpu_irq(cpu);
+        }
+    }
+
+    return cpu->fault.kind;
+}
+
+const Fault *emulator_fault(Emulator *emulator) {
+    return &emulator->cpu.fault;
+}
+
+void emulator_set_framebuffer(Emulator *emulator, void *pixels, PpuFormat format) {
+    ppu_set_framebuffer(&emulator->ppu, pixels, format);
+}
+
+void emulator_set_audio(Emulator *emulator, AudioRing *output, uint32_t sample_rate) {
+    apu_set_output(&emulator->apu, output, sample_rate);
+}
+
+#define STATE_MAGIC "LOYS"
+// Bumped whenever the layout of a state changes
+#define STATE_VERSION 2
+
+// FNV-1a over the whole ROM image, header included, so carts of the same size do not take each other's states.
+// It is worked out the first time a state needs it rather than on load, a mapped ROM is only read as far as
+// the game touches it until then.
+static uint64_t emulator_rom_hash(Emulator *emulator) {
+    if (!emulator->rom_hashed) {
+        uint64_t hash = 0xcbf29ce484222325;
+
+        for (size_t i = 0; i < emulator->cpu.rom.size; i++) {
+            hash = (hash ^ emulator->cpu.rom.data[i]) * 0x100000001b3;
+        }
+
+        emulator->rom_hash = hash;
+        emulator->rom_hashed = true;
+    }
+
+    return emulator->rom_hash;
+}
+
+static void emulator_write_state(Emulator *emulator, StateWriter *writer) {
+    state_write_bytes(writer, STATE_MAGIC, 4);
+    state_write_u32(writer, STATE_VERSION);
+    state_write_u64(writer, emulator_rom_hash(emulator));
+    state_write_u64(writer, emulator->master_clock);
+
+    // The PPU and APU go first, so they are in place when the CPU invalidates the mapper on load
+    ppu_save_state(&emulator->ppu, writer);
+    apu_save_state(&emulator->apu, writer);
+    cpu_save_state(&emulator->cpu, writer);
+}
+
+size_t emulator_state_size(Emulator *emulator) {
+    StateWriter writer = {0};
+
+    emulator_write_state(emulator, &writer);
+
+    return writer.size;
+}
+
+size_t emulator_save_state(Emulator *emulator, void *buffer, size_t capacity) {
+    // Everything lazy is brought up to the CPU so the state does not depend on when it was last touched. The
+    // CPU is left alone, it pays for DMC stalls when it would have without the save.
+    ppu_sync(&emulator->ppu, emulator->cpu.cycles);
+    apu_sync(&emulator->apu, emulator->cpu.cycles);
+    emulator_sync_mapper(emulator);
+
+    StateWriter writer = {.data = buffer, .capacity = capacity};
+
+    emulator_write_state(emulator, &writer);
+
+    return writer.size <= capacity ? writer.size : 0;
+}
+
+bool emulator_load_state(Emulator *emulator, const void *buffer, size_t size) {
+    if (emulator->cpu.mapper.description == NULL || size != emulator_state_size(emulator)) {
+        return false;
+    }
+
+    StateReader reader = {.data = buffer, .size = size};
+    char magic[4];
+
+    state_read_bytes(&reader, magic, 4);
+
+    bool matches = memcmp(magic, STATE_MAGIC, 4) == 0 && state_read_u32(&reader) == STATE_VERSION &&
+                   state_read_u64(&reader) == emulator_rom_hash(emulator);
+    uint64_t master_clock = state_read_u64(&reader);
+
+    // Nothing has been touched yet. Past here every read is in bounds, the size is exactly what this ROM's
+    // states take.
+    if (!matches || reader.failed) {
+        return false;
+    }
+
+    emulator->master_clock = master_clock;
+
+    ppu_load_state(&emulator->ppu, &reader);
+    apu_load_state(&emulator->apu, &reader);
+    cpu_load_state(&emulator->cpu, &reader);
+
+    // Events are derived from the state, not part of it, and the mapper was caught up when it was saved
+    emulator->scheduler.count = 0;
+    emulator->mapper_scanline_clocks = emulator->ppu.scanline_clocks;
+    scheduler_schedule(&emulator->scheduler, EVENT_VBLANK, ppu_next_vblank(&emulator->ppu));
+    emulator_apu_changed(emulator);
+    emulator_mapper_changed(emulator);
 
-    cpu_sync(&emulator->cpu, emulator->master_clock);
+    return true;
 }
@@ -1,16 +1,92 @@
 #pragma once
 
-#include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+#include "apu.h"
+#include "arena.h"
+#include "audio.h"
 #include "cpu.h"
+#include "ppu.h"
+
+// Things that happen at a known master clock, the CPU runs uninterrupted from one to the next
+typedef enum {
+    EVENT_VBLANK,
+    // Frame counter step: envelopes, length counters, sweeps and the frame IRQ
+    EVENT_APU_FRAME,
+    // DMC sample fetch, which stalls the CPU and can raise the DMC IRQ
+    EVENT_DMC,
+    // The mapper's scanline counter reaching the IRQ
+    EVENT_MAPPER_IRQ,
+    EVENT_KIND_COUNT,
+} EventKind;
+
+typedef struct {
+    uint64_t deadline;
+    EventKind kind;
+} Event;
+
+#define SCHEDULER_CAPACITY 8
+
+_Static_assert(EVENT_KIND_COUNT <= SCHEDULER_CAPACITY, "every kind of event needs room in the scheduler");
+
+// A binary min-heap on deadline, holding at most one pending event of each kind
+typedef struct {
+    Event events[SCHEDULER_CAPACITY];
+    int count;
+} Scheduler;
 
 typedef struct {
     Cpu cpu;
-    uint16_t master_clock;
+    Ppu ppu;
+    Apu apu;
+    Scheduler scheduler;
+    uint64_t master_clock;
+    // The PPU's scanline_clocks the mapper has been handed so far
+    uint64_t mapper_scanline_clocks;
+
+    // Where ROMs are loaded into, everything past rom_mark belongs to the loaded ROM
+    Arena *arena;
+    size_t rom_mark;
+    // Identifies the loaded ROM in save states, valid once rom_hashed is set
+    uint64_t rom_hash;
+    bool rom_hashed;
+    // Backs arena for emulators that were not made by emulator_create, allocated on the first load
+    Arena owned_arena;
 } Emulator;
 
+// Size of the arena an emulator reserves for itself, enough for the mapper state of the largest iNES ROM or
+// for the whole ROM when it comes from a pipe. Mapped ROMs do not take any of it, and pages that are never
+// touched take no memory.
+#define EMULATOR_ARENA_SIZE (32 * 1024 * 1024)
+
+// Allocates a powered on emulator from the arena, NULL when it does not fit. Every ROM it loads comes from the
+// same arena, as can its framebuffer, so resetting the arena tears it all down at once.
+Emulator *emulator_create(Arena *);
+// Unloads the ROM and frees the arena of an emulator that was not made by emulator_create
+void emulator_destroy(Emulator *);
+
 void emulator_power_on(Emulator *);
-void emulator_load_rom(Emulator *, const char *rom_path);
+bool emulator_load_rom(Emulator *, const char *rom_path);
+// Hands everything allocated for the ROM back to the arena
+void emulator_unload_rom(Emulator *);
 bool emulator_stopped(Emulator *);
-void emulator_step(Emulator *, uint16_t steps);
+FaultKind emulator_step(Emulator *, uint64_t cycles);
+const Fault *emulator_fault(Emulator *);
+
+// Frames are drawn into pixels, which has to hold PPU_WIDTH * PPU_HEIGHT pixels of the given format, until
+// another framebuffer is set. NULL stops drawing, which is the fastest way to run headless.
+void emulator_set_framebuffer(Emulator *, void *pixels, PpuFormat format);
+
+// Every frame, sample_rate samples per second of audio are pushed into output, until another output is set.
+// NULL stops producing audio, which leaves only what games can observe running.
+void emulator_set_audio(Emulator *, AudioRing *output, uint32_t sample_rate);
+
+// Save states hold everything a game can change and nothing that comes from the ROM, so they only load into an
+// emulator running the same ROM. Their size is fixed for a given ROM.
+size_t emulator_state_size(Emulator *);
+// Returns the size of the state, or 0 when it needs more than capacity bytes
+size_t emulator_save_state(Emulator *, void *buffer, size_t capacity);
+// Returns false, leaving the emulator untouched, when the state is from another ROM or another version
+bool emulator_load_state(Emulator *, const void *buffer, size_t size);
@@ -1 +0,0 @@
-void exit(int __status) __attribute__((__noreturn__));
@@ -1,78 +1,124 @@
 #include <errno.h>
-#include <malloc.h>
+#include <fcntl.h>
 #include <stdint.h>
-#include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#include "exit.h"
+#include "arena.h"
 #include "fs.h"
 
-uint8_t read_byte(FILE *file, const char *path) {
-    uint8_t byte;
+// Reads until the end of the file or until buffer is full, returns -1 on errors
+static ssize_t read_all(int fd, uint8_t *buffer, size_t capacity) {
+    size_t size = 0;
 
-    int n = fread(&byte, 1, 1, file);
+    while (size < capacity) {
+        ssize_t n = read(fd, buffer + size, capacity - size);
 
-    if (ferror(file)) {
-        fprintf(stderr, "error: could not read from file '%s': %s\n", path, strerror(errno));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
 
-        fclose(file);
+        if (n < 0) {
+            return -1;
+        }
 
-        exit(1);
+        if (n == 0) {
+            break;
+        }
+
+        size += n;
     }
 
-    if (n != 1) {
-        fprintf(stderr, "error: file '%s' is smaller than expected: was trying to read 1 byte\n", path);
+    return size;
+}
+
+// Standard input belongs to the process, it is read but left open
+static void close_file(int fd) {
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+}
 
-        fclose(file);
+bool map_file(const char *path, Arena *arena, FileContents *contents) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
 
-        exit(1);
+    if (fd < 0) {
+        return false;
     }
 
-    return byte;
-}
+    struct stat stat;
+
+    if (fstat(fd, &stat) < 0) {
+        int error = errno;
+        close_file(fd);
+        errno = error;
+
+        return false;
+    }
+
+    bool sized = S_ISREG(stat.st_mode) && stat.st_size > 0;
 
-uint8_t *read_bytes(FILE *file, const char *path, int amount) {
-    uint8_t *bytes = malloc(amount);
+    if (sized && fd != STDIN_FILENO) {
+        void *data = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
 
-    int n = fread(bytes, 1, amount, file);
+        int error = errno;
+        close(fd);
+        errno = error;
 
-    if (ferror(file)) {
-        fprintf(stderr, "error: could not read from file '%s': %s\n", path, strerror(errno));
+        if (data == MAP_FAILED) {
+            return false;
+        }
 
-        fclose(file);
+        *contents = (FileContents){.data = data, .size = stat.st_size, .mapped = true};
 
-        exit(1);
+        return true;
     }
 
-    if (n != amount) {
-        fprintf(stderr, "error: file '%s' is smaller than expected: was trying to read %d bytes\n", path,
-                amount);
+    // Standard input redirected from a file is read in one go. Pipes have no size, they fill the end of the
+    // arena until they run dry and the arena keeps what they wrote.
+    size_t available;
+    uint8_t *data = arena_tail(arena, &available);
 
-        fclose(file);
+    if (sized && (size_t)stat.st_size > available) {
+        close_file(fd);
+        errno = ENOMEM;
 
-        exit(1);
+        return false;
     }
 
-    return bytes;
-}
+    ssize_t size = read_all(fd, data, sized ? (size_t)stat.st_size : available);
+
+    // A pipe that filled the arena may still have more to give
+    uint8_t probe;
 
-void read_bytes_into(uint8_t *bytes, FILE *file, const char *path, int amount) {
-    int n = fread(bytes, 1, amount, file);
+    if (size >= 0 && !sized && (size_t)size == available && read_all(fd, &probe, 1) == 1) {
+        close_file(fd);
+        errno = ENOMEM;
 
-    if (ferror(file)) {
-        fprintf(stderr, "error: could not read from file '%s': %s\n", path, strerror(errno));
+        return false;
+    }
 
-        fclose(file);
+    int error = errno;
+    close_file(fd);
+    errno = error;
 
-        exit(1);
+    if (size < 0) {
+        return false;
     }
 
-    if (n != amount) {
-        fprintf(stderr, "error: file '%s' is smaller than expected: was trying to read %d bytes\n", path,
-                amount);
+    arena_alloc(arena, size);
+
+    *contents = (FileContents){.data = data, .size = size};
 
-        fclose(file);
+    return true;
+}
 
-        exit(1);
+void unmap_file(FileContents *contents) {
+    if (contents->mapped) {
+        munmap((void *)contents->data, contents->size);
     }
+
+    *contents = (FileContents){0};
 }
@@ -1,8 +1,43 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
-#include <stdio.h>
 
-uint8_t read_byte(FILE *, const char *path);
-uint8_t *read_bytes(FILE *, const char *path, int amount);
-void read_bytes_into(uint8_t *, FILE *, const char *path, int amount);
+#include "arena.h"
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    // Mapped contents are handed back with unmap_file, the others live in the arena they were read into
+    bool mapped;
+} FileContents;
+
+// Maps regular files read-only, so nothing is copied and only the pages that are touched are read. Pipes and
+// "-" for standard input can not be mapped, they are read whole into the arena with as few reads as it takes.
+// Returns false and leaves errno set when the file could not be read, ENOMEM when it does not fit in the arena,
+// which is then left as it was.
+bool map_file(const char *path, Arena *, FileContents *);
+void unmap_file(FileContents *);
+
+// Walks file contents front to back. Taking more than is left yields NULL and marks the cursor failed, every
+// take after that fails too, so a parser can check once after a run of takes.
+typedef struct {
+    FileContents contents;
+    size_t offset;
+    bool failed;
+} FileCursor;
+
+// Returns the next count bytes, which stay where the file is, and moves past them
+static inline const uint8_t *file_take(FileCursor *cursor, uint64_t count) {
+    if (cursor->failed || count > cursor->contents.size - cursor->offset) {
+        cursor->failed = true;
+
+        return NULL;
+    }
+
+    const uint8_t *bytes = cursor->contents.data + cursor->offset;
+    cursor->offset += count;
+
+    return bytes;
+}
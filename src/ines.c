@@ -0,0 +1,85 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ines.h"
+#include "mapper.h"
+
+// NES 2.0 gives RAM sizes as shift counts, 0 meaning none
+static uint32_t ines_ram_size(uint8_t shift) { return shift == 0 ? 0 : 64u << shift; }
+
+// NES 2.0 ROM sizes are a count of units, or an exponent and a multiplier when the upper nibble is all ones
+static uint64_t ines_rom_size(uint8_t lsb, uint8_t msb, uint32_t unit) {
+    if (msb == 0x0f) {
+        // Anything past 2^40 is bigger than any file and would only overflow
+        if ((lsb >> 2) > 40) {
+            return UINT64_MAX;
+        }
+
+        return ((uint64_t)1 << (lsb >> 2)) * ((lsb & 3) * 2 + 1);
+    }
+
+    return (uint64_t)((msb << 8) | lsb) * unit;
+}
+
+void ines_parse_header(const uint8_t *header, InesHeader *ines) {
+    uint8_t flag6 = header[6];
+    uint8_t flag7 = header[7];
+
+    memset(ines, 0, sizeof(InesHeader));
+
+    ines->nes2 = (flag7 & 0x0c) == 0x08;
+    ines->battery = flag6 & (1 << 1);
+    ines->trainer = flag6 & (1 << 2);
+
+    ines->mirroring = flag6 & 1 ? MIRRORING_VERTICAL : MIRRORING_HORIZONTAL;
+
+    if (flag6 & (1 << 3)) {
+        ines->mirroring = MIRRORING_FOUR_SCREEN;
+    }
+
+    if (ines->nes2) {
+        ines->mapper = ((header[8] & 0x0f) << 8) | (flag7 & 0xf0) | (flag6 >> 4);
+        ines->submapper = header[8] >> 4;
+
+        ines->prg_rom_size = ines_rom_size(header[4], header[9] & 0x0f, 0x4000);
+        ines->chr_rom_size = ines_rom_size(header[5], header[9] >> 4, 0x2000);
+
+        ines->prg_ram_size = ines_ram_size(header[10] & 0x0f);
+        ines->prg_nvram_size = ines_ram_size(header[10] >> 4);
+        ines->chr_ram_size = ines_ram_size(header[11] & 0x0f);
+        ines->chr_nvram_size = ines_ram_size(header[11] >> 4);
+
+        ines->timing = header[12] & 3;
+
+        return;
+    }
+
+    // Old dumping tools wrote their name over bytes 7 to 15, "DiskDude!" being the usual one, so those are
+    // only trusted when the unused bytes at the end are zero
+    uint8_t flag8 = header[8];
+    uint8_t flag9 = header[9];
+
+    if (header[12] != 0 || header[13] != 0 || header[14] != 0 || header[15] != 0) {
+        flag7 = flag8 = flag9 = 0;
+    }
+
+    ines->mapper = (flag7 & 0xf0) | (flag6 >> 4);
+
+    ines->prg_rom_size = header[4] * 0x4000;
+    ines->chr_rom_size = header[5] * 0x2000;
+
+    // PRG RAM in 8 KiB units, where 0 still means 8 KiB since carts never said whether they had any. Carts
+    // without CHR ROM have 8 KiB of CHR RAM.
+    uint32_t prg_ram_size = (flag8 > 0 ? flag8 : 1) * 0x2000;
+
+    if (ines->battery) {
+        ines->prg_nvram_size = prg_ram_size;
+    } else {
+        ines->prg_ram_size = prg_ram_size;
+    }
+
+    ines->chr_ram_size = ines->chr_rom_size == 0 ? 0x2000 : 0;
+
+    ines->timing = flag9 & 1 ? INES_TIMING_PAL : INES_TIMING_NTSC;
+}
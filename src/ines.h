@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mapper.h"
+
+#define INES_HEADER_SIZE 16
+#define INES_TRAINER_SIZE 512
+
+// The smallest banks mappers switch, ROM has to be made of whole ones. NES 2.0 exponent sizes can be
+// anything, and a few bytes of PRG or CHR would have every bank reach past the end of the ROM.
+#define INES_PRG_BANK_SIZE 0x2000
+#define INES_CHR_BANK_SIZE 0x400
+
+// The console a cart was made for, only NTSC timing is emulated
+typedef enum {
+    INES_TIMING_NTSC,
+    INES_TIMING_PAL,
+    INES_TIMING_MULTI_REGION,
+    INES_TIMING_DENDY,
+} InesTiming;
+
+// The 16 byte header in front of iNES and NES 2.0 files. Old iNES headers leave out what NES 2.0 added, which
+// is then filled in with what carts of the time usually had.
+typedef struct {
+    bool nes2;
+    uint16_t mapper;
+    uint8_t submapper;
+    Mirroring mirroring;
+    bool battery;
+    bool trainer;
+    InesTiming timing;
+
+    // ROM sizes can be given as an exponent in NES 2.0, which goes far beyond anything a file can hold
+    uint64_t prg_rom_size;
+    uint64_t chr_rom_size;
+
+    // Cartridge RAM in bytes, NVRAM is the part kept alive by the battery
+    uint32_t prg_ram_size;
+    uint32_t prg_nvram_size;
+    uint32_t chr_ram_size;
+    uint32_t chr_nvram_size;
+} InesHeader;
+
+// The magic is up to the caller to check
+void ines_parse_header(const uint8_t *header, InesHeader *);
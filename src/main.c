@@ -1,26 +1,234 @@
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "bench.h"
 #include "emulator.h"
 
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [options] <rom>\n", program);
+    fprintf(stderr, "  <rom> is read from standard input when it is -\n");
+    fprintf(stderr, "  --bench          measure the speed of the emulator instead of running the ROM\n");
+    fprintf(stderr, "  --cycles <n>     cycles measured per benchmark run (default: 10 s of NTSC time)\n");
+    fprintf(stderr, "  --warmup <n>     cycles run before each measurement (default: 1 s of NTSC time)\n");
+    fprintf(stderr, "  --runs <n>       number of benchmark runs (default: 5)\n");
+    fprintf(stderr, "  --bench-tiles    measure the tile decoders, no ROM needed\n");
+    fprintf(stderr, "  --frames <n>     stop after n frames\n");
+    fprintf(stderr, "  --screenshot <f> write the last frame to f as a PPM image\n");
+    fprintf(stderr, "  --wav <f>        write the audio to f as a mono 16-bit WAV file\n");
+}
+
+#define WAV_SAMPLE_RATE 48000
+#define WAV_RING_CAPACITY (1 << 15)
+#define WAV_HEADER_SIZE 44
+
+static void write_le(FILE *file, uint32_t value, int size) {
+    for (int i = 0; i < size; i++) {
+        fputc((value >> (i * 8)) & 0xff, file);
+    }
+}
+
+// Sizes are left at zero until wav_close patches them in
+static FILE *wav_open(const char *path) {
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "error: could not open file '%s': %s\n", path, strerror(errno));
+
+        return NULL;
+    }
+
+    fwrite("RIFF", 1, 4, file);
+    write_le(file, 0, 4);
+    fwrite("WAVEfmt ", 1, 8, file);
+    write_le(file, 16, 4);
+    write_le(file, 1, 2);
+    write_le(file, 1, 2);
+    write_le(file, WAV_SAMPLE_RATE, 4);
+    write_le(file, WAV_SAMPLE_RATE * 2, 4);
+    write_le(file, 2, 2);
+    write_le(file, 16, 2);
+    fwrite("data", 1, 4, file);
+    write_le(file, 0, 4);
+
+    return file;
+}
+
+static void wav_drain(FILE *file, AudioRing *ring, uint32_t *samples_written) {
+    int16_t samples[1024];
+    size_t count;
+
+    while ((count = audio_ring_read(ring, samples, 1024)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            write_le(file, (uint16_t)samples[i], 2);
+        }
+
+        *samples_written += count;
+    }
+}
+
+static void wav_close(FILE *file, uint32_t samples_written) {
+    uint32_t data_size = samples_written * 2;
+
+    fseek(file, 4, SEEK_SET);
+    write_le(file, WAV_HEADER_SIZE - 8 + data_size, 4);
+    fseek(file, WAV_HEADER_SIZE - 4, SEEK_SET);
+    write_le(file, data_size, 4);
+    fclose(file);
+}
+
+static bool write_screenshot(const char *path, const uint8_t *pixels) {
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "error: could not open file '%s': %s\n", path, strerror(errno));
+
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", PPU_WIDTH, PPU_HEIGHT);
+
+    for (int i = 0; i < PPU_WIDTH * PPU_HEIGHT; i++) {
+        fwrite(pixels + i * 4, 1, 3, file);
+    }
+
+    fclose(file);
+
+    return true;
+}
+
 int main(int argc, const char *argv[]) {
     const char *program = argv[0];
+    const char *rom_path = NULL;
+    const char *screenshot_path = NULL;
+    const char *wav_path = NULL;
+    uint64_t frames = 0;
+
+    bool bench = false;
+    bool bench_tile_decoders = false;
+    BenchOptions bench_options = {
+        .warmup_cycles = 1789773,
+        .cycles = 17897730,
+        .runs = 5,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *argument = argv[i];
+        bool has_value = i + 1 < argc;
 
-    if (argc < 2) {
-        fprintf(stderr, "usage: %s <rom>\n", program);
+        if (strcmp(argument, "--bench") == 0) {
+            bench = true;
+        } else if (strcmp(argument, "--bench-tiles") == 0) {
+            bench_tile_decoders = true;
+        } else if (strcmp(argument, "--cycles") == 0 && has_value) {
+            bench_options.cycles = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argument, "--warmup") == 0 && has_value) {
+            bench_options.warmup_cycles = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argument, "--runs") == 0 && has_value) {
+            bench_options.runs = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argument, "--frames") == 0 && has_value) {
+            frames = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argument, "--screenshot") == 0 && has_value) {
+            screenshot_path = argv[++i];
+        } else if (strcmp(argument, "--wav") == 0 && has_value) {
+            wav_path = argv[++i];
+        } else if (rom_path == NULL && (argument[0] != '-' || strcmp(argument, "-") == 0)) {
+            rom_path = argument;
+        } else {
+            usage(program);
+            fprintf(stderr, "error: unexpected argument '%s'\n", argument);
+
+            return 1;
+        }
+    }
+
+    if (bench_tile_decoders) {
+        return bench_tiles(bench_options.runs < 1 ? 1 : bench_options.runs);
+    }
+
+    if (rom_path == NULL) {
+        usage(program);
         fprintf(stderr, "error: expected a file\n");
 
         return 1;
     }
 
-    const char *rom_path = argv[1];
+    if (bench) {
+        if (bench_options.runs < 1) {
+            fprintf(stderr, "error: expected at least one benchmark run\n");
 
-    Emulator emulator = {0};
+            return 1;
+        }
+
+        // Every run loads the ROM again, standard input only has it once
+        if (strcmp(rom_path, "-") == 0) {
+            fprintf(stderr, "error: benchmarks need the ROM as a file\n");
+
+            return 1;
+        }
+
+        return bench_run(rom_path, bench_options);
+    }
+
+    static Emulator emulator;
+    static uint8_t framebuffer[PPU_WIDTH * PPU_HEIGHT * 4];
+
+    if (screenshot_path != NULL) {
+        emulator_set_framebuffer(&emulator, framebuffer, PPU_FORMAT_RGBA);
+    }
+
+    static int16_t audio_storage[WAV_RING_CAPACITY];
+    AudioRing audio;
+    FILE *wav = NULL;
+    uint32_t samples_written = 0;
+
+    if (wav_path != NULL) {
+        wav = wav_open(wav_path);
+
+        if (wav == NULL) {
+            return 1;
+        }
+
+        audio_ring_init(&audio, audio_storage, WAV_RING_CAPACITY);
+        emulator_set_audio(&emulator, &audio, WAV_SAMPLE_RATE);
+    }
 
     emulator_power_on(&emulator);
 
-    emulator_load_rom(&emulator, rom_path);
+    if (!emulator_load_rom(&emulator, rom_path)) {
+        fprintf(stderr, "error: %s\n", emulator_fault(&emulator)->message);
 
-    while (!emulator_stopped(&emulator)) {
+        return 1;
+    }
+
+    while (!emulator_stopped(&emulator) && (frames == 0 || emulator.ppu.frame < frames)) {
         emulator_step(&emulator, 1024);
+
+        if (wav != NULL) {
+            wav_drain(wav, &audio, &samples_written);
+        }
+    }
+
+    if (wav != NULL) {
+        wav_close(wav, samples_written);
+    }
+
+    if (screenshot_path != NULL && !write_screenshot(screenshot_path, framebuffer)) {
+        return 1;
+    }
+
+#ifdef LOYD_PROFILE
+    cpu_profile_dump(&emulator.cpu, stderr);
+#endif
+
+    Fault fault = *emulator_fault(&emulator);
+
+    emulator_destroy(&emulator);
+
+    if (fault.kind != FAULT_NONE) {
+        fprintf(stderr, "error: %s\n", fault.message);
+
+        return 1;
     }
 }
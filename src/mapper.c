@@ -1,58 +1,901 @@
-#include <malloc.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "arena.h"
 #include "mapper.h"
+#include "state.h"
+#include "tile.h"
 
+// CHR ROM, or CHR RAM for carts without it, decoded into tiles at load. Banks are picked by offset and wrap
+// around, so bank numbers past the end of the cart mirror like the address lines would.
 typedef struct {
-    uint8_t *prg_rom;
+    const uint8_t *rom;
+    uint8_t *ram;
+    uint32_t size;
+    // 4 bytes for every byte of CHR
+    uint8_t *tiles;
+} MapperChr;
+
+static bool mapper_chr_init(MapperChr *chr, Arena *arena, const MapperCart *cart) {
+    if (cart->chr_rom_size > 0) {
+        chr->rom = cart->chr_rom;
+        chr->ram = NULL;
+        chr->size = cart->chr_rom_size;
+    } else {
+        // A whole bank at least, and 8 KiB for headers that claim no CHR at all
+        chr->rom = NULL;
+        chr->size = cart->chr_ram_size < 0x400 ? 0x400 : cart->chr_ram_size;
+
+        if (cart->chr_ram_size == 0) {
+            chr->size = 0x2000;
+        }
+
+        chr->ram = arena_alloc(arena, chr->size);
+    }
+
+    chr->tiles = arena_alloc(arena, chr->size * 4);
+
+    if (chr->tiles == NULL || (chr->rom == NULL && chr->ram == NULL)) {
+        return false;
+    }
+
+    if (chr->ram != NULL) {
+        // Blank CHR RAM decodes to blank tiles
+        memset(chr->ram, 0, chr->size);
+        memset(chr->tiles, 0, chr->size * 4);
+    } else {
+        tile_decode_chr(chr->rom, chr->size, chr->tiles);
+    }
+
+    return true;
+}
+
+static MapperBank mapper_chr_bank(MapperChr *chr, uint32_t offset) {
+    offset %= chr->size;
+
+    if (chr->ram != NULL) {
+        uint8_t *memory = chr->ram + offset;
+
+        return (MapperBank){.read = memory, .write = memory, .tiles = chr->tiles + offset * 4};
+    }
+
+    return (MapperBank){.read = chr->rom + offset, .write = NULL, .tiles = chr->tiles + offset * 4};
+}
+
+// Only CHR RAM can change
+static void mapper_chr_save_state(MapperChr *chr, StateWriter *writer) {
+    if (chr->ram != NULL) {
+        state_write_bytes(writer, chr->ram, chr->size);
+    }
+}
+
+static void mapper_chr_load_state(MapperChr *chr, StateReader *reader) {
+    if (chr->ram != NULL) {
+        state_read_bytes(reader, chr->ram, chr->size);
+        tile_decode_chr(chr->ram, chr->size, chr->tiles);
+    }
+}
+
+// How much of the cart's PRG RAM a board can address, rounded up to whole pages of the CPU's page table
+static uint32_t mapper_prg_ram_size(const MapperCart *cart, uint32_t addressable) {
+    uint32_t size = cart->prg_ram_size > addressable ? addressable : cart->prg_ram_size;
+
+    return (size + 0xff) & ~0xff;
+}
+
+// A page of the 8 KiB PRG RAM window at $6000 looking at the RAM from offset on, RAM smaller than the window
+// is mirrored across it
+static MapperBank mapper_prg_ram_page(uint8_t *prg_ram, uint32_t prg_ram_size, uint32_t offset,
+                                      uint8_t page) {
+    if (prg_ram_size == 0) {
+        return (MapperBank){0};
+    }
+
+    uint8_t *memory = prg_ram + (offset + ((page - 0x60) << 8)) % prg_ram_size;
+
+    return (MapperBank){.read = memory, .write = memory};
+}
+
+typedef struct {
+    const uint8_t *prg_rom;
     uint32_t prg_rom_size;
-    uint8_t *chr_rom;
-    uint32_t chr_rom_size;
+    MapperChr chr;
+    Mirroring mirroring;
+
+    uint32_t prg_ram_size;
+    uint8_t prg_ram[];
 } NromMapper;
 
-void nrom_mapper_map_ram(void *context, uint8_t *ram) {
+MapperBank nrom_mapper_prg_page(void *context, uint8_t page) {
     NromMapper *mapper = context;
 
-    memcpy(ram + 0x8000, mapper->prg_rom, mapper->prg_rom_size);
+    if (page < 0x80) {
+        return mapper_prg_ram_page(mapper->prg_ram, mapper->prg_ram_size, 0, page);
+    }
 
-    if (mapper->prg_rom_size == 16 * 1024) {
-        memcpy(ram + 0xC000, mapper->prg_rom, mapper->prg_rom_size);
+    if (mapper->prg_rom_size == 0) {
+        return (MapperBank){0};
     }
+
+    // 16 KiB carts are mirrored into $C000
+    return (MapperBank){.read = mapper->prg_rom + (((page - 0x80) << 8) % mapper->prg_rom_size)};
+}
+
+MapperBank nrom_mapper_chr_bank(void *context, uint8_t bank) {
+    NromMapper *mapper = context;
+
+    return mapper_chr_bank(&mapper->chr, bank << 10);
 }
 
 MapperDesription nrom_mapper_description(void *context) {
-    (void)context;
+    NromMapper *mapper = context;
 
     return (MapperDesription){
-        .instruction_pointer = 0x8000,
         .registers_start = 0,
         .registers_end = 0,
+        .mirroring = mapper->mirroring,
     };
 }
 
-void nrom_mapper_free(void *context) {
+// Only PRG RAM and CHR RAM can change
+void nrom_mapper_save_state(void *context, StateWriter *writer) {
+    NromMapper *mapper = context;
+
+    state_write_bytes(writer, mapper->prg_ram, mapper->prg_ram_size);
+    mapper_chr_save_state(&mapper->chr, writer);
+}
+
+void nrom_mapper_load_state(void *context, StateReader *reader) {
     NromMapper *mapper = context;
 
-    free(mapper->prg_rom);
-    free(mapper->chr_rom);
-    free(mapper);
+    state_read_bytes(reader, mapper->prg_ram, mapper->prg_ram_size);
+    mapper_chr_load_state(&mapper->chr, reader);
 }
 
-Mapper nrom_mapper(uint8_t *prg_rom, uint32_t prg_rom_size, uint8_t *chr_rom, uint32_t chr_rom_size) {
-    NromMapper *mapper = malloc(sizeof(NromMapper));
+static Mapper nrom_mapper(Arena *arena, const MapperCart *cart) {
+    // NROM has no way to bank PRG RAM, only the first 8 KiB are reachable
+    uint32_t prg_ram_size = mapper_prg_ram_size(cart, 0x2000);
 
-    mapper->prg_rom = prg_rom;
-    mapper->chr_rom = chr_rom;
+    NromMapper *mapper = arena_alloc(arena, sizeof(NromMapper) + prg_ram_size);
 
-    mapper->prg_rom_size = prg_rom_size;
-    mapper->chr_rom_size = chr_rom_size;
+    if (mapper == NULL || !mapper_chr_init(&mapper->chr, arena, cart)) {
+        return (Mapper){0};
+    }
+
+    mapper->prg_ram_size = prg_ram_size;
+    memset(mapper->prg_ram, 0, prg_ram_size);
+
+    mapper->prg_rom = cart->prg_rom;
+    mapper->prg_rom_size = cart->prg_rom_size;
+
+    mapper->mirroring = cart->mirroring;
 
     return (Mapper){
         .context = mapper,
-        .map_ram = nrom_mapper_map_ram,
+        .prg_page = nrom_mapper_prg_page,
+        .chr_bank = nrom_mapper_chr_bank,
         .description = nrom_mapper_description,
         .register_write = NULL,
-        .free = nrom_mapper_free,
+        .save_state = nrom_mapper_save_state,
+        .load_state = nrom_mapper_load_state,
     };
 }
+
+// MMC1 takes its five registers a bit at a time through a shift register that any write to $8000-$FFFF feeds,
+// the fifth write lands in the register its address selects. Bank switches only move the offsets below.
+typedef struct {
+    const uint8_t *prg_rom;
+    uint32_t prg_rom_size;
+    MapperChr chr;
+
+    uint8_t shift;
+    uint8_t shift_count;
+    uint8_t control;
+    uint8_t chr_banks[2];
+    uint8_t prg_bank;
+
+    // Derived from the registers: the two 16 KiB halves of $8000-$FFFF, the two 4 KiB halves of the pattern
+    // tables and the 8 KiB bank of PRG RAM at $6000
+    uint32_t prg_offsets[2];
+    uint32_t chr_offsets[2];
+    bool prg_ram_enabled;
+    uint32_t prg_ram_offset;
+
+    uint32_t prg_ram_size;
+    uint8_t prg_ram[];
+} Mmc1Mapper;
+
+static void mmc1_mapper_update_banks(Mmc1Mapper *mapper) {
+    // Carts with 512 KiB of PRG ROM pick the 256 KiB half with a bit of the CHR bank registers
+    uint32_t prg_outer = mapper->prg_rom_size > 0x40000 ? (mapper->chr_banks[0] & 0x10) << 14 : 0;
+    uint32_t prg_bank = mapper->prg_bank & 0x0f;
+    uint32_t prg_offsets[2];
+
+    switch ((mapper->control >> 2) & 3) {
+    case 0:
+    case 1:
+        // 32 KiB at once, ignoring the low bit
+        prg_offsets[0] = (prg_bank & ~1) << 14;
+        prg_offsets[1] = (prg_bank | 1) << 14;
+        break;
+    case 2:
+        // First bank fixed at $8000
+        prg_offsets[0] = 0;
+        prg_offsets[1] = prg_bank << 14;
+        break;
+    default:
+        // Last bank fixed at $C000
+        prg_offsets[0] = prg_bank << 14;
+        prg_offsets[1] = 0x3c000;
+        break;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        mapper->prg_offsets[i] = prg_outer | prg_offsets[i];
+    }
+
+    if (mapper->control & 0x10) {
+        mapper->chr_offsets[0] = mapper->chr_banks[0] << 12;
+        mapper->chr_offsets[1] = mapper->chr_banks[1] << 12;
+    } else {
+        // 8 KiB at once, ignoring the low bit
+        mapper->chr_offsets[0] = (mapper->chr_banks[0] & ~1) << 12;
+        mapper->chr_offsets[1] = (mapper->chr_banks[0] | 1) << 12;
+    }
+
+    // Carts with more than 8 KiB of PRG RAM bank it with bits 2 and 3 of the first CHR bank register, and
+    // bit 4 of the PRG bank register disables it
+    mapper->prg_ram_enabled = !(mapper->prg_bank & 0x10);
+    mapper->prg_ram_offset = ((mapper->chr_banks[0] >> 2) & 3) << 13;
+}
+
+MapperBank mmc1_mapper_prg_page(void *context, uint8_t page) {
+    Mmc1Mapper *mapper = context;
+
+    if (page < 0x80) {
+        if (!mapper->prg_ram_enabled) {
+            return (MapperBank){0};
+        }
+
+        return mapper_prg_ram_page(mapper->prg_ram, mapper->prg_ram_size, mapper->prg_ram_offset, page);
+    }
+
+    if (mapper->prg_rom_size == 0) {
+        return (MapperBank){0};
+    }
+
+    // Wrapped a page at a time, NES 2.0 carts can be a multiple of 8 KiB that a 16 KiB bank runs past
+    uint32_t offset = mapper->prg_offsets[(page >> 6) & 1] + ((page & 0x3f) << 8);
+
+    return (MapperBank){.read = mapper->prg_rom + offset % mapper->prg_rom_size};
+}
+
+MapperBank mmc1_mapper_chr_bank(void *context, uint8_t bank) {
+    Mmc1Mapper *mapper = context;
+
+    return mapper_chr_bank(&mapper->chr, mapper->chr_offsets[bank >> 2] + ((bank & 3) << 10));
+}
+
+bool mmc1_mapper_register_write(void *context, uint16_t pointer, uint8_t byte) {
+    Mmc1Mapper *mapper = context;
+
+    uint8_t control = mapper->control;
+    uint8_t chr_banks[2] = {mapper->chr_banks[0], mapper->chr_banks[1]};
+    uint8_t prg_bank = mapper->prg_bank;
+
+    if (byte & 0x80) {
+        // Reset the shift register and go back to the last bank fixed at $C000
+        mapper->shift = 0;
+        mapper->shift_count = 0;
+        mapper->control |= 0x0c;
+    } else {
+        mapper->shift |= (byte & 1) << mapper->shift_count;
+
+        if (++mapper->shift_count < 5) {
+            return false;
+        }
+
+        uint8_t value = mapper->shift;
+
+        mapper->shift = 0;
+        mapper->shift_count = 0;
+
+        switch ((pointer >> 13) & 3) {
+        case 0:
+            mapper->control = value;
+            break;
+        case 1:
+            mapper->chr_banks[0] = value;
+            break;
+        case 2:
+            mapper->chr_banks[1] = value;
+            break;
+        default:
+            mapper->prg_bank = value;
+            break;
+        }
+    }
+
+    // Games tend to rewrite the bank they are already on, which leaves the caches alone
+    if (mapper->control == control && mapper->chr_banks[0] == chr_banks[0] &&
+        mapper->chr_banks[1] == chr_banks[1] && mapper->prg_bank == prg_bank) {
+        return false;
+    }
+
+    mmc1_mapper_update_banks(mapper);
+
+    return true;
+}
+
+MapperDesription mmc1_mapper_description(void *context) {
+    Mmc1Mapper *mapper = context;
+
+    static const Mirroring mirrorings[] = {
+        MIRRORING_SINGLE_LOWER,
+        MIRRORING_SINGLE_UPPER,
+        MIRRORING_VERTICAL,
+        MIRRORING_HORIZONTAL,
+    };
+
+    return (MapperDesription){
+        .registers_start = 0x8000,
+        .registers_end = 0x10000,
+        .mirroring = mirrorings[mapper->control & 3],
+    };
+}
+
+void mmc1_mapper_save_state(void *context, StateWriter *writer) {
+    Mmc1Mapper *mapper = context;
+
+    state_write_u8(writer, mapper->shift);
+    state_write_u8(writer, mapper->shift_count);
+    state_write_u8(writer, mapper->control);
+    state_write_u8(writer, mapper->chr_banks[0]);
+    state_write_u8(writer, mapper->chr_banks[1]);
+    state_write_u8(writer, mapper->prg_bank);
+    state_write_bytes(writer, mapper->prg_ram, mapper->prg_ram_size);
+    mapper_chr_save_state(&mapper->chr, writer);
+}
+
+void mmc1_mapper_load_state(void *context, StateReader *reader) {
+    Mmc1Mapper *mapper = context;
+
+    mapper->shift = state_read_u8(reader);
+    mapper->shift_count = state_read_u8(reader);
+    mapper->control = state_read_u8(reader);
+    mapper->chr_banks[0] = state_read_u8(reader);
+    mapper->chr_banks[1] = state_read_u8(reader);
+    mapper->prg_bank = state_read_u8(reader);
+    state_read_bytes(reader, mapper->prg_ram, mapper->prg_ram_size);
+    mapper_chr_load_state(&mapper->chr, reader);
+
+    // The fifth write empties the shift register, a fuller one can only come from a damaged state
+    if (mapper->shift_count >= 5) {
+        mapper->shift = 0;
+        mapper->shift_count = 0;
+    }
+
+    mmc1_mapper_update_banks(mapper);
+}
+
+// Mirroring is up to the game
+static Mapper mmc1_mapper(Arena *arena, const MapperCart *cart) {
+    // The largest boards have 32 KiB of PRG RAM in four banks
+    uint32_t prg_ram_size = mapper_prg_ram_size(cart, 0x8000);
+
+    Mmc1Mapper *mapper = arena_alloc(arena, sizeof(Mmc1Mapper) + prg_ram_size);
+
+    if (mapper == NULL || !mapper_chr_init(&mapper->chr, arena, cart)) {
+        return (Mapper){0};
+    }
+
+    mapper->prg_rom = cart->prg_rom;
+    mapper->prg_rom_size = cart->prg_rom_size;
+
+    mapper->prg_ram_size = prg_ram_size;
+    memset(mapper->prg_ram, 0, prg_ram_size);
+
+    // Powers on with the last bank fixed at $C000, so the reset vector is always there
+    mapper->shift = 0;
+    mapper->shift_count = 0;
+    mapper->control = 0x0c;
+    mapper->chr_banks[0] = 0;
+    mapper->chr_banks[1] = 0;
+    mapper->prg_bank = 0;
+
+    mmc1_mapper_update_banks(mapper);
+
+    return (Mapper){
+        .context = mapper,
+        .prg_page = mmc1_mapper_prg_page,
+        .chr_bank = mmc1_mapper_chr_bank,
+        .description = mmc1_mapper_description,
+        .register_write = mmc1_mapper_register_write,
+        .save_state = mmc1_mapper_save_state,
+        .load_state = mmc1_mapper_load_state,
+    };
+}
+
+// MMC3 switches 8 KiB PRG banks and 1 or 2 KiB CHR banks through eight bank registers, and counts scanlines
+// for an IRQ. Just like MMC1, bank switches only move the bases below.
+typedef struct {
+    const uint8_t *prg_rom;
+    uint32_t prg_rom_size;
+    MapperChr chr;
+    bool four_screen;
+
+    uint8_t bank_select;
+    uint8_t banks[8];
+    bool horizontal;
+
+    uint8_t irq_latch;
+    uint8_t irq_counter;
+    bool irq_reload;
+    bool irq_enabled;
+    bool irq;
+
+    // Derived from the registers: the four 8 KiB quarters of $8000-$FFFF and the eight 1 KiB CHR banks
+    const uint8_t *prg_bases[4];
+    uint32_t chr_offsets[8];
+
+    uint32_t prg_ram_size;
+    uint8_t prg_ram[];
+} Mmc3Mapper;
+
+static void mmc3_mapper_update_banks(Mmc3Mapper *mapper) {
+    uint32_t second_last = mapper->prg_rom_size - 0x4000;
+    uint32_t prg_offsets[4] = {
+        mapper->banks[6] << 13,
+        mapper->banks[7] << 13,
+        second_last,
+        second_last + 0x2000,
+    };
+
+    // PRG mode 1 swaps the banks at $8000 and $C000
+    if (mapper->bank_select & 0x40) {
+        prg_offsets[0] = second_last;
+        prg_offsets[2] = mapper->banks[6] << 13;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (mapper->prg_rom_size < 0x4000) {
+            mapper->prg_bases[i] = NULL;
+        } else {
+            mapper->prg_bases[i] = mapper->prg_rom + prg_offsets[i] % mapper->prg_rom_size;
+        }
+    }
+
+    // Two 2 KiB banks in one half of the pattern tables and four 1 KiB banks in the other, CHR inversion
+    // picks which half is which
+    uint32_t chr_offsets[8] = {
+        (mapper->banks[0] & ~1) << 10,
+        (mapper->banks[0] | 1) << 10,
+        (mapper->banks[1] & ~1) << 10,
+        (mapper->banks[1] | 1) << 10,
+        mapper->banks[2] << 10,
+        mapper->banks[3] << 10,
+        mapper->banks[4] << 10,
+        mapper->banks[5] << 10,
+    };
+    int inversion = mapper->bank_select & 0x80 ? 4 : 0;
+
+    for (int i = 0; i < 8; i++) {
+        mapper->chr_offsets[i ^ inversion] = chr_offsets[i];
+    }
+}
+
+MapperBank mmc3_mapper_prg_page(void *context, uint8_t page) {
+    Mmc3Mapper *mapper = context;
+
+    if (page < 0x80) {
+        return mapper_prg_ram_page(mapper->prg_ram, mapper->prg_ram_size, 0, page);
+    }
+
+    const uint8_t *base = mapper->prg_bases[(page >> 5) & 3];
+
+    if (base == NULL) {
+        return (MapperBank){0};
+    }
+
+    return (MapperBank){.read = base + ((page & 0x1f) << 8)};
+}
+
+MapperBank mmc3_mapper_chr_bank(void *context, uint8_t bank) {
+    Mmc3Mapper *mapper = context;
+
+    return mapper_chr_bank(&mapper->chr, mapper->chr_offsets[bank]);
+}
+
+bool mmc3_mapper_register_write(void *context, uint16_t pointer, uint8_t byte) {
+    Mmc3Mapper *mapper = context;
+
+    // Four pairs of registers, one at even and one at odd addresses
+    switch (pointer & 0xe001) {
+    case 0x8000:
+        if (((mapper->bank_select ^ byte) & 0xc0) == 0) {
+            mapper->bank_select = byte;
+            return false;
+        }
+
+        mapper->bank_select = byte;
+        break;
+
+    case 0x8001:
+        if (mapper->banks[mapper->bank_select & 7] == byte) {
+            return false;
+        }
+
+        mapper->banks[mapper->bank_select & 7] = byte;
+        break;
+
+    case 0xa000:
+        if (mapper->horizontal == (byte & 1)) {
+            return false;
+        }
+
+        mapper->horizontal = byte & 1;
+        return true;
+
+    case 0xc000:
+        mapper->irq_latch = byte;
+        return false;
+
+    case 0xc001:
+        // The counter reloads from the latch on the next clock
+        mapper->irq_counter = 0;
+        mapper->irq_reload = true;
+        return false;
+
+    case 0xe000:
+        mapper->irq_enabled = false;
+        mapper->irq = false;
+        return false;
+
+    case 0xe001:
+        mapper->irq_enabled = true;
+        return false;
+
+    default:
+        // PRG RAM protection at $A001 is left alone, MMC6 boards share the mapper number and use it
+        // differently
+        return false;
+    }
+
+    mmc3_mapper_update_banks(mapper);
+
+    return true;
+}
+
+MapperDesription mmc3_mapper_description(void *context) {
+    Mmc3Mapper *mapper = context;
+    Mirroring mirroring = mapper->horizontal ? MIRRORING_HORIZONTAL : MIRRORING_VERTICAL;
+
+    return (MapperDesription){
+        .registers_start = 0x8000,
+        .registers_end = 0x10000,
+        .mirroring = mapper->four_screen ? MIRRORING_FOUR_SCREEN : mirroring,
+    };
+}
+
+static void mmc3_mapper_raise_irq(Mmc3Mapper *mapper) {
+    if (mapper->irq_enabled) {
+        mapper->irq = true;
+    }
+}
+
+// Works out where count clocks leave the counter without stepping through them. Each clock reloads the
+// counter when it is 0 or a reload is pending and decrements it otherwise, raising the IRQ whenever that
+// leaves it at 0.
+void mmc3_mapper_clock_scanlines(void *context, uint64_t count) {
+    Mmc3Mapper *mapper = context;
+
+    if (count == 0) {
+        return;
+    }
+
+    if (mapper->irq_counter == 0 || mapper->irq_reload) {
+        mapper->irq_counter = mapper->irq_latch;
+        mapper->irq_reload = false;
+        count--;
+
+        // With a latch of 0 the counter stays at 0 and every clock raises the IRQ
+        if (mapper->irq_counter == 0) {
+            mmc3_mapper_raise_irq(mapper);
+            return;
+        }
+    }
+
+    if (count < mapper->irq_counter) {
+        mapper->irq_counter -= count;
+        return;
+    }
+
+    count -= mapper->irq_counter;
+    mapper->irq_counter = 0;
+    mmc3_mapper_raise_irq(mapper);
+
+    // From there on the counter goes round latch + 1 values, reaching 0 once every round
+    uint64_t remaining = count % (mapper->irq_latch + 1);
+
+    if (remaining > 0) {
+        mapper->irq_counter = mapper->irq_latch - (remaining - 1);
+    }
+}
+
+uint32_t mmc3_mapper_scanlines_until_irq(void *context) {
+    Mmc3Mapper *mapper = context;
+
+    if (!mapper->irq_enabled) {
+        return 0;
+    }
+
+    if (mapper->irq_counter == 0 || mapper->irq_reload) {
+        return mapper->irq_latch + 1;
+    }
+
+    return mapper->irq_counter;
+}
+
+bool mmc3_mapper_irq(void *context) {
+    Mmc3Mapper *mapper = context;
+
+    return mapper->irq;
+}
+
+void mmc3_mapper_save_state(void *context, StateWriter *writer) {
+    Mmc3Mapper *mapper = context;
+
+    state_write_u8(writer, mapper->bank_select);
+    state_write_bytes(writer, mapper->banks, sizeof(mapper->banks));
+    state_write_u8(writer, mapper->horizontal);
+    state_write_u8(writer, mapper->irq_latch);
+    state_write_u8(writer, mapper->irq_counter);
+    state_write_u8(writer, mapper->irq_reload);
+    state_write_u8(writer, mapper->irq_enabled);
+    state_write_u8(writer, mapper->irq);
+    state_write_bytes(writer, mapper->prg_ram, mapper->prg_ram_size);
+    mapper_chr_save_state(&mapper->chr, writer);
+}
+
+void mmc3_mapper_load_state(void *context, StateReader *reader) {
+    Mmc3Mapper *mapper = context;
+
+    mapper->bank_select = state_read_u8(reader);
+    state_read_bytes(reader, mapper->banks, sizeof(mapper->banks));
+    mapper->horizontal = state_read_u8(reader);
+    mapper->irq_latch = state_read_u8(reader);
+    mapper->irq_counter = state_read_u8(reader);
+    mapper->irq_reload = state_read_u8(reader);
+    mapper->irq_enabled = state_read_u8(reader);
+    mapper->irq = state_read_u8(reader);
+    state_read_bytes(reader, mapper->prg_ram, mapper->prg_ram_size);
+    mapper_chr_load_state(&mapper->chr, reader);
+
+    mmc3_mapper_update_banks(mapper);
+}
+
+// Mirroring is up to the game unless the cart has four screens of its own
+static Mapper mmc3_mapper(Arena *arena, const MapperCart *cart) {
+    // MMC3 has no way to bank PRG RAM, only the first 8 KiB are reachable
+    uint32_t prg_ram_size = mapper_prg_ram_size(cart, 0x2000);
+
+    Mmc3Mapper *mapper = arena_alloc(arena, sizeof(Mmc3Mapper) + prg_ram_size);
+
+    if (mapper == NULL || !mapper_chr_init(&mapper->chr, arena, cart)) {
+        return (Mapper){0};
+    }
+
+    mapper->prg_rom = cart->prg_rom;
+    mapper->prg_rom_size = cart->prg_rom_size;
+    mapper->four_screen = cart->mirroring == MIRRORING_FOUR_SCREEN;
+
+    mapper->prg_ram_size = prg_ram_size;
+    memset(mapper->prg_ram, 0, prg_ram_size);
+
+    mapper->bank_select = 0;
+    memset(mapper->banks, 0, sizeof(mapper->banks));
+    mapper->horizontal = cart->mirroring == MIRRORING_HORIZONTAL;
+
+    mapper->irq_latch = 0;
+    mapper->irq_counter = 0;
+    mapper->irq_reload = false;
+    mapper->irq_enabled = false;
+    mapper->irq = false;
+
+    mmc3_mapper_update_banks(mapper);
+
+    return (Mapper){
+        .context = mapper,
+        .prg_page = mmc3_mapper_prg_page,
+        .chr_bank = mmc3_mapper_chr_bank,
+        .description = mmc3_mapper_description,
+        .register_write = mmc3_mapper_register_write,
+        .save_state = mmc3_mapper_save_state,
+        .load_state = mmc3_mapper_load_state,
+        .clock_scanlines = mmc3_mapper_clock_scanlines,
+        .scanlines_until_irq = mmc3_mapper_scanlines_until_irq,
+        .irq = mmc3_mapper_irq,
+    };
+}
+
+// Discrete logic boards: a single latch written anywhere in $8000-$FFFF, which each board wires up to the
+// bank lines differently. Its layout function derives the banks from the latch.
+typedef struct DiscreteMapper DiscreteMapper;
+
+struct DiscreteMapper {
+    const uint8_t *prg_rom;
+    uint32_t prg_rom_size;
+    MapperChr chr;
+    void (*layout)(DiscreteMapper *);
+
+    uint8_t latch;
+
+    // Derived from the latch: the two 16 KiB halves of $8000-$FFFF, the 8 KiB of CHR and the mirroring
+    uint32_t prg_offsets[2];
+    uint32_t chr_offset;
+    Mirroring mirroring;
+
+    uint32_t prg_ram_size;
+    uint8_t prg_ram[];
+};
+
+// UxROM switches the 16 KiB at $8000, the last 16 KiB are fixed at $C000
+static void uxrom_layout(DiscreteMapper *mapper) {
+    mapper->prg_offsets[0] = mapper->latch << 14;
+    mapper->prg_offsets[1] = mapper->prg_rom_size - 0x4000;
+}
+
+// CNROM switches 8 KiB of CHR ROM, PRG is laid out like NROM
+static void cnrom_layout(DiscreteMapper *mapper) {
+    mapper->prg_offsets[0] = 0;
+    mapper->prg_offsets[1] = 0x4000;
+    mapper->chr_offset = mapper->latch << 13;
+}
+
+// AxROM switches 32 KiB at once and picks one of the nametables for all four
+static void axrom_layout(DiscreteMapper *mapper) {
+    mapper->prg_offsets[0] = (mapper->latch & 0x07) << 15;
+    mapper->prg_offsets[1] = mapper->prg_offsets[0] + 0x4000;
+    mapper->mirroring = mapper->latch & 0x10 ? MIRRORING_SINGLE_UPPER : MIRRORING_SINGLE_LOWER;
+}
+
+// GxROM switches 32 KiB of PRG with bits 4 and 5 and 8 KiB of CHR with bits 0 and 1
+static void gxrom_layout(DiscreteMapper *mapper) {
+    mapper->prg_offsets[0] = ((mapper->latch >> 4) & 0x03) << 15;
+    mapper->prg_offsets[1] = mapper->prg_offsets[0] + 0x4000;
+    mapper->chr_offset = (mapper->latch & 0x03) << 13;
+}
+
+MapperBank discrete_mapper_prg_page(void *context, uint8_t page) {
+    DiscreteMapper *mapper = context;
+
+    if (page < 0x80) {
+        return mapper_prg_ram_page(mapper->prg_ram, mapper->prg_ram_size, 0, page);
+    }
+
+    if (mapper->prg_rom_size == 0) {
+        return (MapperBank){0};
+    }
+
+    uint32_t offset = mapper->prg_offsets[(page >> 6) & 1] + ((page & 0x3f) << 8);
+
+    return (MapperBank){.read = mapper->prg_rom + offset % mapper->prg_rom_size};
+}
+
+MapperBank discrete_mapper_chr_bank(void *context, uint8_t bank) {
+    DiscreteMapper *mapper = context;
+
+    return mapper_chr_bank(&mapper->chr, mapper->chr_offset + (bank << 10));
+}
+
+bool discrete_mapper_register_write(void *context, uint16_t pointer, uint8_t byte) {
+    DiscreteMapper *mapper = context;
+
+    (void)pointer;
+
+    if (mapper->latch == byte) {
+        return false;
+    }
+
+    mapper->latch = byte;
+    mapper->layout(mapper);
+
+    return true;
+}
+
+MapperDesription discrete_mapper_description(void *context) {
+    DiscreteMapper *mapper = context;
+
+    return (MapperDesription){
+        .registers_start = 0x8000,
+        .registers_end = 0x10000,
+        .mirroring = mapper->mirroring,
+    };
+}
+
+void discrete_mapper_save_state(void *context, StateWriter *writer) {
+    DiscreteMapper *mapper = context;
+
+    state_write_u8(writer, mapper->latch);
+    state_write_bytes(writer, mapper->prg_ram, mapper->prg_ram_size);
+    mapper_chr_save_state(&mapper->chr, writer);
+}
+
+void discrete_mapper_load_state(void *context, StateReader *reader) {
+    DiscreteMapper *mapper = context;
+
+    mapper->latch = state_read_u8(reader);
+    state_read_bytes(reader, mapper->prg_ram, mapper->prg_ram_size);
+    mapper_chr_load_state(&mapper->chr, reader);
+
+    mapper->layout(mapper);
+}
+
+static Mapper discrete_mapper(Arena *arena, const MapperCart *cart, void (*layout)(DiscreteMapper *)) {
+    // None of these boards bank PRG RAM, only the first 8 KiB are reachable
+    uint32_t prg_ram_size = mapper_prg_ram_size(cart, 0x2000);
+
+    DiscreteMapper *mapper = arena_alloc(arena, sizeof(DiscreteMapper) + prg_ram_size);
+
+    if (mapper == NULL || !mapper_chr_init(&mapper->chr, arena, cart)) {
+        return (Mapper){0};
+    }
+
+    mapper->prg_rom = cart->prg_rom;
+    mapper->prg_rom_size = cart->prg_rom_size;
+    mapper->layout = layout;
+
+    mapper->prg_ram_size = prg_ram_size;
+    memset(mapper->prg_ram, 0, prg_ram_size);
+
+    // Boards that do not switch them keep the CHR and mirroring they were built with
+    mapper->latch = 0;
+    mapper->chr_offset = 0;
+    mapper->mirroring = cart->mirroring;
+    mapper->layout(mapper);
+
+    return (Mapper){
+        .context = mapper,
+        .prg_page = discrete_mapper_prg_page,
+        .chr_bank = discrete_mapper_chr_bank,
+        .description = discrete_mapper_description,
+        .register_write = discrete_mapper_register_write,
+        .save_state = discrete_mapper_save_state,
+        .load_state = discrete_mapper_load_state,
+    };
+}
+
+static Mapper uxrom_mapper(Arena *arena, const MapperCart *cart) {
+    return discrete_mapper(arena, cart, uxrom_layout);
+}
+static Mapper cnrom_mapper(Arena *arena, const MapperCart *cart) {
+    return discrete_mapper(arena, cart, cnrom_layout);
+}
+static Mapper axrom_mapper(Arena *arena, const MapperCart *cart) {
+    return discrete_mapper(arena, cart, axrom_layout);
+}
+static Mapper gxrom_mapper(Arena *arena, const MapperCart *cart) {
+    return discrete_mapper(arena, cart, gxrom_layout);
+}
+
+// Ordered by number
+static const MapperEntry mapper_entries[] = {
+    {0, "NROM", nrom_mapper},
+    {1, "MMC1", mmc1_mapper},
+    {2, "UxROM", uxrom_mapper},
+    {3, "CNROM", cnrom_mapper},
+    {4, "MMC3", mmc3_mapper},
+    {7, "AxROM", axrom_mapper},
+    {66, "GxROM", gxrom_mapper},
+};
+
+const MapperEntry *mapper_find(uint16_t id) {
+    for (size_t i = 0; i < sizeof(mapper_entries) / sizeof(mapper_entries[0]); i++) {
+        if (mapper_entries[i].id == id) {
+            return &mapper_entries[i];
+        }
+    }
+
+    return NULL;
+}
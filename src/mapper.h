@@ -1,23 +1,90 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "arena.h"
+#include "state.h"
+
+// How the two 1 KiB nametables inside the console are laid out over the four the PPU addresses
+typedef enum {
+    MIRRORING_HORIZONTAL,
+    MIRRORING_VERTICAL,
+    MIRRORING_SINGLE_LOWER,
+    MIRRORING_SINGLE_UPPER,
+    MIRRORING_FOUR_SCREEN,
+} Mirroring;
+
 typedef struct {
-    uint16_t instruction_pointer;
+    // Writes from registers_start up to but not including registers_end go to register_write
     uint16_t registers_start;
-    uint16_t registers_end;
+    uint32_t registers_end;
+    Mirroring mirroring;
 } MapperDesription;
 
+// Host memory backing a bank, write is NULL when the bank is ROM. CHR banks also come with their tiles
+// decoded by tile_decode_chr, which whoever writes to the bank keeps up to date.
+typedef struct {
+    const uint8_t *read;
+    uint8_t *write;
+    uint8_t *tiles;
+} MapperBank;
+
 typedef struct {
     void *context;
 
-    void (*map_ram)(void *context, uint8_t *ram);
+    // Host memory backing a 256 byte page of the CPU address space from $6000 up: PRG RAM below $8000 and PRG
+    // ROM from there, read is NULL if nothing is mapped. The CPU keeps the returned pointers until the mapper
+    // invalidates them.
+    MapperBank (*prg_page)(void *context, uint8_t page);
+
+    // Host memory backing one of the eight 1 KiB banks of the PPU pattern tables, kept by the PPU until the
+    // mapper invalidates it just like the PRG pages
+    MapperBank (*chr_bank)(void *context, uint8_t bank);
 
-    void (*register_write)(void *context, uint16_t pointer, uint8_t byte);
+    // Returns true when the write switched banks or moved the register window, which invalidates whatever
+    // the caller has cached from the description or the mapped memory
+    bool (*register_write)(void *context, uint16_t pointer, uint8_t byte);
 
+    // Only queried on load and after an invalidating register write, so it is free to be slow
     MapperDesription (*description)(void *context);
 
-    void (*free)(void *context);
+    // Append to and restore from a save state everything the game can change: bank registers, IRQ counters
+    // and cartridge RAM. Restoring is followed by invalidating the mapper.
+    void (*save_state)(void *context, StateWriter *);
+    void (*load_state)(void *context, StateReader *);
+
+    // Scanline counters for IRQs, NULL on mappers without one. The PPU tallies the clocks the counter would
+    // see and the emulator hands them over in bulk, before every register write and when the IRQ is due.
+    void (*clock_scanlines)(void *context, uint64_t count);
+    // Clocks until the counter raises the IRQ line, 0 when it will not
+    uint32_t (*scanlines_until_irq)(void *context);
+    // Level of the IRQ line, held until the game acknowledges it
+    bool (*irq)(void *context);
 } Mapper;
 
-Mapper nrom_mapper(uint8_t *prg_rom, uint32_t prg_rom_size, uint8_t *chr_rom, uint32_t chr_rom_size);
+// Everything the header says about the cart, ROM stays where the caller has it
+typedef struct {
+    const uint8_t *prg_rom;
+    uint32_t prg_rom_size;
+    const uint8_t *chr_rom;
+    uint32_t chr_rom_size;
+    // Cartridge RAM in bytes, battery backed or not. Mappers take what their boards can address.
+    uint32_t prg_ram_size;
+    uint32_t chr_ram_size;
+    Mirroring mirroring;
+    // NES 2.0 tells apart boards sharing a mapper number, 0 when it does not
+    uint8_t submapper;
+} MapperCart;
+
+// One supported mapper. The constructor allocates everything the mapper needs from the arena, which takes it
+// all back when it is rewound, and returns a mapper whose context is NULL when the arena is out of room. The
+// mapper brings its own bank layout and save state hooks, everything else only talks to it through those.
+typedef struct {
+    uint16_t id;
+    const char *name;
+    Mapper (*create)(Arena *, const MapperCart *);
+} MapperEntry;
+
+// Looks up a mapper by its iNES or NES 2.0 number, NULL when it is not supported
+const MapperEntry *mapper_find(uint16_t id);
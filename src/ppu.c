@@ -0,0 +1,731 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "clock.h"
+#include "mapper.h"
+#include "ppu.h"
+#include "tile.h"
+
+#define PPU_CONTROL_INCREMENT_32 (1 << 2)
+#define PPU_CONTROL_SPRITE_TABLE (1 << 3)
+#define PPU_CONTROL_BACKGROUND_TABLE (1 << 4)
+#define PPU_CONTROL_TALL_SPRITES (1 << 5)
+#define PPU_CONTROL_NMI (1 << 7)
+
+#define PPU_MASK_GRAYSCALE 1
+#define PPU_MASK_BACKGROUND_LEFT (1 << 1)
+#define PPU_MASK_SPRITES_LEFT (1 << 2)
+#define PPU_MASK_BACKGROUND (1 << 3)
+#define PPU_MASK_SPRITES (1 << 4)
+
+#define PPU_STATUS_SPRITE_OVERFLOW (1 << 5)
+#define PPU_STATUS_SPRITE_ZERO_HIT (1 << 6)
+#define PPU_STATUS_VBLANK (1 << 7)
+
+#define PPU_VBLANK_SCANLINE 241
+#define PPU_PRERENDER_SCANLINE 261
+
+// Sprite line pixels keep the palette index in their low 5 bits and these flags on top
+#define PPU_SPRITE_BEHIND (1 << 6)
+#define PPU_SPRITE_ZERO (1 << 7)
+
+// The 2C02 colors in R, G, B, A order
+static const uint8_t ppu_rgba_palette[64][4] = {
+    {0x66, 0x66, 0x66, 0xFF}, {0x00, 0x2A, 0x88, 0xFF}, {0x14, 0x12, 0xA7, 0xFF}, {0x3B, 0x00, 0xA4, 0xFF},
+    {0x5C, 0x00, 0x7E, 0xFF}, {0x6E, 0x00, 0x40, 0xFF}, {0x6C, 0x06, 0x00, 0xFF}, {0x56, 0x1D, 0x00, 0xFF},
+    {0x33, 0x35, 0x00, 0xFF}, {0x0B, 0x48, 0x00, 0xFF}, {0x00, 0x52, 0x00, 0xFF}, {0x00, 0x4F, 0x08, 0xFF},
+    {0x00, 0x40, 0x4D, 0xFF}, {0x00, 0x00, 0x00, 0xFF}, {0x00, 0x00, 0x00, 0xFF}, {0x00, 0x00, 0x00, 0xFF},
+    {0xAD, 0xAD, 0xAD, 0xFF}, {0x15, 0x5F, 0xD9, 0xFF}, {0x42, 0x40, 0xFF, 0xFF}, {0x75, 0x27, 0xFE, 0xFF},
+    {0xA0, 0x1A, 0xCC, 0xFF}, {0xB7, 0x1E, 0x7B, 0xFF}, {0xB5, 0x31, 0x20, 0xFF}, {0x99, 0x4E, 0x00, 0xFF},
+    {0x6B, 0x6D, 0x00, 0xFF}, {0x38, 0x87, 0x00, 0xFF}, {0x0C, 0x93, 0x00, 0xFF}, {0x00, 0x8F, 0x32, 0xFF},
+    {0x00, 0x7C, 0x8D, 0xFF}, {0x00, 0x00, 0x00, 0xFF}, {0x00, 0x00, 0x00, 0xFF}, {0x00, 0x00, 0x00, 0xFF},
+    {0xFF, 0xFE, 0xFF, 0xFF}, {0x64, 0xB0, 0xFF, 0xFF}, {0x92, 0x90, 0xFF, 0xFF}, {0xC6, 0x76, 0xFF, 0xFF},
+    {0xF3, 0x6A, 0xFF, 0xFF}, {0xFE, 0x6E, 0xCC, 0xFF}, {0xFE, 0x81, 0x70, 0xFF}, {0xEA, 0x9E, 0x22, 0xFF},
+    {0xBC, 0xBE, 0x00, 0xFF}, {0x88, 0xD8, 0x00, 0xFF}, {0x5C, 0xE4, 0x30, 0xFF}, {0x45, 0xE0, 0x82, 0xFF},
+    {0x48, 0xCD, 0xDE, 0xFF}, {0x4F, 0x4F, 0x4F, 0xFF}, {0x00, 0x00, 0x00, 0xFF}, {0x00, 0x00, 0x00, 0xFF},
+    {0xFF, 0xFE, 0xFF, 0xFF}, {0xC0, 0xDF, 0xFF, 0xFF}, {0xD3, 0xD2, 0xFF, 0xFF}, {0xE8, 0xC8, 0xFF, 0xFF},
+    {0xFB, 0xC2, 0xFF, 0xFF}, {0xFE, 0xC4, 0xEA, 0xFF}, {0xFE, 0xCC, 0xC5, 0xFF}, {0xF7, 0xD8, 0xA5, 0xFF},
+    {0xE4, 0xE5, 0x94, 0xFF}, {0xCF, 0xEF, 0x96, 0xFF}, {0xBD, 0xF4, 0xAB, 0xFF}, {0xB3, 0xF3, 0xCC, 0xFF},
+    {0xB5, 0xEB, 0xF2, 0xFF}, {0xB8, 0xB8, 0xB8, 0xFF}, {0x00, 0x00, 0x00, 0xFF}, {0x00, 0x00, 0x00, 0xFF},
+};
+
+void ppu_power_on(Ppu *ppu) {
+    // The framebuffer belongs to the caller and outlives power cycles
+    uint8_t *framebuffer = ppu->framebuffer;
+    PpuFormat format = ppu->format;
+
+    memset(ppu, 0, sizeof(Ppu));
+
+    ppu->framebuffer = framebuffer;
+    ppu->format = format;
+
+    for (int i = 0; i < 4; i++) {
+        ppu->nametable_pages[i] = ppu->nametables[0];
+    }
+}
+
+static void ppu_map_nametables(Ppu *ppu, Mirroring mirroring) {
+    static const uint8_t layouts[][4] = {
+        [MIRRORING_HORIZONTAL] = {0, 0, 1, 1},
+        [MIRRORING_VERTICAL] = {0, 1, 0, 1},
+        [MIRRORING_SINGLE_LOWER] = {0, 0, 0, 0},
+        [MIRRORING_SINGLE_UPPER] = {1, 1, 1, 1},
+        [MIRRORING_FOUR_SCREEN] = {0, 1, 2, 3},
+    };
+
+    for (int i = 0; i < 4; i++) {
+        ppu->nametable_pages[i] = ppu->nametables[layouts[mirroring][i]];
+    }
+}
+
+void ppu_map_mapper(Ppu *ppu, Mapper *mapper, MapperDesription *description) {
+    for (uint8_t i = 0; i < 8; i++) {
+        MapperBank bank = mapper->chr_bank(mapper->context, i);
+
+        ppu->chr_read[i] = bank.read;
+        ppu->chr_write[i] = bank.write;
+        ppu->chr_tiles[i] = bank.tiles;
+    }
+
+    ppu->counts_scanlines = mapper->clock_scanlines != NULL;
+
+    ppu_map_nametables(ppu, description->mirroring);
+}
+
+// Only four-screen carts add the other two nametables, everything else mirrors the two inside the console
+static uint8_t ppu_nametable_count(Ppu *ppu) { return ppu->nametable_pages[2] == ppu->nametables[2] ? 4 : 2; }
+
+void ppu_save_state(Ppu *ppu, StateWriter *writer) {
+    uint8_t nametable_count = ppu_nametable_count(ppu);
+
+    state_write_u8(writer, ppu->control);
+    state_write_u8(writer, ppu->mask);
+    state_write_u8(writer, ppu->status);
+    state_write_u8(writer, ppu->oam_address);
+    state_write_u16(writer, ppu->v);
+    state_write_u16(writer, ppu->t);
+    state_write_u8(writer, ppu->fine_x);
+    state_write_u8(writer, ppu->write_toggle);
+    state_write_u8(writer, ppu->read_buffer);
+    state_write_u8(writer, ppu->latch);
+
+    state_write_bytes(writer, ppu->oam, sizeof(ppu->oam));
+    state_write_bytes(writer, ppu->palette, sizeof(ppu->palette));
+    state_write_u8(writer, nametable_count);
+    state_write_bytes(writer, ppu->nametables, nametable_count * sizeof(ppu->nametables[0]));
+
+    state_write_u64(writer, ppu->clock);
+    state_write_u16(writer, ppu->scanline);
+    state_write_u16(writer, ppu->dot);
+    state_write_u8(writer, ppu->odd_frame);
+    state_write_u64(writer, ppu->frame);
+    state_write_u8(writer, ppu->nmi);
+}
+
+void ppu_load_state(Ppu *ppu, StateReader *reader) {
+    ppu->control = state_read_u8(reader);
+    ppu->mask = state_read_u8(reader);
+    ppu->status = state_read_u8(reader);
+    ppu->oam_address = state_read_u8(reader);
+    ppu->v = state_read_u16(reader) & 0x7fff;
+    ppu->t = state_read_u16(reader) & 0x7fff;
+    ppu->fine_x = state_read_u8(reader) & 7;
+    ppu->write_toggle = state_read_u8(reader) != 0;
+    ppu->read_buffer = state_read_u8(reader);
+    ppu->latch = state_read_u8(reader);
+
+    state_read_bytes(reader, ppu->oam, sizeof(ppu->oam));
+    state_read_bytes(reader, ppu->palette, sizeof(ppu->palette));
+
+    uint8_t nametable_count = state_read_u8(reader) == 4 ? 4 : 2;
+
+    state_read_bytes(reader, ppu->nametables, nametable_count * sizeof(ppu->nametables[0]));
+
+    ppu->clock = state_read_u64(reader);
+    ppu->scanline = state_read_u16(reader);
+    ppu->dot = state_read_u16(reader);
+    ppu->odd_frame = state_read_u8(reader) != 0;
+    ppu->frame = state_read_u64(reader);
+    ppu->nmi = state_read_u8(reader) != 0;
+
+    // Everything below can only be out of range in a damaged state. The renderer indexes its line buffers
+    // with the position and the RGBA table with the palette.
+    for (size_t i = 0; i < sizeof(ppu->palette); i++) {
+        ppu->palette[i] &= 0x3f;
+    }
+
+    if (ppu->scanline >= PPU_SCANLINES_PER_FRAME) {
+        ppu->scanline = PPU_SCANLINES_PER_FRAME - 1;
+    }
+
+    if (ppu->dot >= PPU_DOTS_PER_SCANLINE) {
+        ppu->dot = PPU_DOTS_PER_SCANLINE - 1;
+    }
+}
+
+void ppu_set_framebuffer(Ppu *ppu, void *pixels, PpuFormat format) {
+    ppu->framebuffer = pixels;
+    ppu->format = format;
+}
+
+// The backdrop entries of the sprite palettes mirror the background ones
+static inline uint8_t ppu_palette_index(uint16_t pointer) {
+    uint8_t index = pointer & 0x1f;
+
+    return (index & 0x13) == 0x10 ? index & 0x0f : index;
+}
+
+static inline uint8_t ppu_read(Ppu *ppu, uint16_t pointer) {
+    pointer &= 0x3fff;
+
+    if (pointer < 0x2000) {
+        const uint8_t *bank = ppu->chr_read[(pointer >> 10) & 7];
+
+        return bank != NULL ? bank[pointer & 0x3ff] : 0;
+    }
+
+    if (pointer < 0x3f00) {
+        return ppu->nametable_pages[(pointer >> 10) & 3][pointer & 0x3ff];
+    }
+
+    return ppu->palette[ppu_palette_index(pointer)];
+}
+
+// One row of a pattern table tile out of the tile cache, pattern is the address of the row in its low plane
+static inline uint8_t *ppu_tile_row(Ppu *ppu, uint16_t pattern) {
+    static uint8_t blank_row[8];
+
+    uint8_t *tiles = ppu->chr_tiles[(pattern >> 10) & 7];
+
+    if (tiles == NULL) {
+        return blank_row;
+    }
+
+    return tiles + ((pattern & 0x3f0) << 2) + ((pattern & 7) << 3);
+}
+
+static void ppu_write(Ppu *ppu, uint16_t pointer, uint8_t byte) {
+    pointer &= 0x3fff;
+
+    if (pointer < 0x2000) {
+        uint8_t *bank = ppu->chr_write[pointer >> 10];
+
+        if (bank != NULL) {
+            bank[pointer & 0x3ff] = byte;
+
+            // Decode the row again so the tile cache follows CHR RAM
+            uint16_t row = pointer & 0x3f7;
+            static const uint8_t no_palette = 0;
+
+            tile_decode_rows(bank + row, bank + (row | 8), &no_palette, 1, ppu_tile_row(ppu, pointer));
+        }
+    } else if (pointer < 0x3f00) {
+        ppu->nametable_pages[(pointer >> 10) & 3][pointer & 0x3ff] = byte;
+    } else {
+        ppu->palette[ppu_palette_index(pointer)] = byte & 0x3f;
+    }
+}
+
+static bool ppu_rendering(Ppu *ppu) { return (ppu->mask & (PPU_MASK_BACKGROUND | PPU_MASK_SPRITES)) != 0; }
+
+static void ppu_increment_address(Ppu *ppu) {
+    ppu->v = (ppu->v + (ppu->control & PPU_CONTROL_INCREMENT_32 ? 32 : 1)) & 0x7fff;
+}
+
+// Moves v down one pixel, wrapping from the last row of tiles into the vertically adjacent nametable
+static void ppu_increment_y(Ppu *ppu) {
+    if ((ppu->v & 0x7000) != 0x7000) {
+        ppu->v += 0x1000;
+        return;
+    }
+
+    ppu->v &= ~0x7000;
+
+    uint16_t coarse_y = (ppu->v >> 5) & 0x1f;
+
+    if (coarse_y == 29) {
+        coarse_y = 0;
+        ppu->v ^= 0x0800;
+    } else if (coarse_y == 31) {
+        // Rows 30 and 31 hold the attributes, scrolling into them wraps without switching nametables
+        coarse_y = 0;
+    } else {
+        coarse_y++;
+    }
+
+    ppu->v = (ppu->v & ~0x03e0) | (coarse_y << 5);
+}
+
+static void ppu_copy_x(Ppu *ppu) { ppu->v = (ppu->v & ~0x041f) | (ppu->t & 0x041f); }
+
+static void ppu_copy_y(Ppu *ppu) { ppu->v = (ppu->v & ~0x7be0) | (ppu->t & 0x7be0); }
+
+// Draws 33 tiles starting at v, so the line is complete for any fine X scroll
+static void ppu_render_background(Ppu *ppu, uint8_t *pixels) {
+    uint16_t v = ppu->v;
+    uint16_t pattern_table = ppu->control & PPU_CONTROL_BACKGROUND_TABLE ? 0x1000 : 0;
+    uint16_t fine_y = (v >> 12) & 7;
+
+    for (int tile = 0; tile < 33; tile++) {
+        uint8_t index = ppu_read(ppu, 0x2000 | (v & 0x0fff));
+        uint8_t attribute = ppu_read(ppu, 0x23c0 | (v & 0x0c00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+        uint64_t palette = ((attribute >> (((v >> 4) & 4) | (v & 2))) & 3) << 2;
+
+        // The palette goes on the 8 opaque pixels of the row at once, 1 in the low bit of a byte marks an
+        // opaque one and multiplying spreads the palette onto them without carrying into the next byte
+        uint64_t row;
+        memcpy(&row, ppu_tile_row(ppu, pattern_table | (index << 4) | fine_y), 8);
+
+        uint64_t opaque = (row | (row >> 1)) & 0x0101010101010101ULL;
+        row |= opaque * palette;
+
+        memcpy(pixels + tile * 8, &row, 8);
+
+        // Coarse X wraps into the horizontally adjacent nametable
+        if ((v & 0x1f) == 31) {
+            v = (v & ~0x1f) ^ 0x0400;
+        } else {
+            v++;
+        }
+    }
+}
+
+static int ppu_sprite_height(Ppu *ppu) { return ppu->control & PPU_CONTROL_TALL_SPRITES ? 16 : 8; }
+
+// Sprite Y coordinates are one line early, so a sprite shows up on the line after the one it names
+static int ppu_sprite_row(Ppu *ppu, const uint8_t *sprite) { return ppu->scanline - sprite[0] - 1; }
+
+static void ppu_render_sprites(Ppu *ppu, uint8_t *pixels) {
+    int height = ppu_sprite_height(ppu);
+    int count = 0;
+
+    memset(pixels, 0, PPU_WIDTH);
+
+    for (int i = 0; i < 64; i++) {
+        const uint8_t *sprite = &ppu->oam[i * 4];
+        int row = ppu_sprite_row(ppu, sprite);
+
+        if (row < 0 || row >= height) {
+            continue;
+        }
+
+        // Only eight sprites fit on a line
+        if (count++ == 8) {
+            ppu->status |= PPU_STATUS_SPRITE_OVERFLOW;
+            break;
+        }
+
+        uint8_t tile = sprite[1];
+        uint8_t attributes = sprite[2];
+
+        // Flipped vertically
+        uint8_t line = attributes & 0x80 ? height - 1 - row : row;
+
+        uint16_t pattern;
+
+        if (height == 16) {
+            // Tall sprites pick their pattern table with the low bit of the tile index
+            pattern = ((tile & 1) << 12) | (((tile & 0xfe) + (line >> 3)) << 4) | (line & 7);
+        } else {
+            pattern = (ppu->control & PPU_CONTROL_SPRITE_TABLE ? 0x1000 : 0) | (tile << 4) | line;
+        }
+
+        const uint8_t *colors = ppu_tile_row(ppu, pattern);
+
+        uint8_t flags = 0x10 | ((attributes & 3) << 2) | (attributes & 0x20 ? PPU_SPRITE_BEHIND : 0) |
+                        (i == 0 ? PPU_SPRITE_ZERO : 0);
+
+        for (int j = 0; j < 8 && sprite[3] + j < PPU_WIDTH; j++) {
+            // Flipped horizontally
+            uint8_t color = colors[attributes & 0x40 ? 7 - j : j];
+
+            // Sprites earlier in OAM are drawn in front of later ones
+            if (color != 0 && pixels[sprite[3] + j] == 0) {
+                pixels[sprite[3] + j] = flags | color;
+            }
+        }
+    }
+}
+
+// What ppu_render_sprites does to the status, for lines that are not drawn
+static void ppu_evaluate_sprite_overflow(Ppu *ppu) {
+    int height = ppu_sprite_height(ppu);
+    int count = 0;
+
+    for (int i = 0; i < 64; i++) {
+        int row = ppu_sprite_row(ppu, &ppu->oam[i * 4]);
+
+        if (row >= 0 && row < height && count++ == 8) {
+            ppu->status |= PPU_STATUS_SPRITE_OVERFLOW;
+            return;
+        }
+    }
+}
+
+static void ppu_output_scanline(Ppu *ppu, const uint8_t *colors) {
+    if (ppu->format == PPU_FORMAT_INDEXED) {
+        memcpy(ppu->framebuffer + ppu->scanline * PPU_WIDTH, colors, PPU_WIDTH);
+        return;
+    }
+
+    uint8_t *pixels = ppu->framebuffer + ppu->scanline * PPU_WIDTH * 4;
+
+    for (int x = 0; x < PPU_WIDTH; x++) {
+        memcpy(pixels + x * 4, ppu_rgba_palette[colors[x]], 4);
+    }
+}
+
+static void ppu_render_scanline(Ppu *ppu) {
+    bool background_enabled = ppu->mask & PPU_MASK_BACKGROUND;
+    bool sprites_enabled = ppu->mask & PPU_MASK_SPRITES;
+
+    // Without a framebuffer the only visible effects of a line are the sprite flags
+    if (ppu->framebuffer == NULL) {
+        if (sprites_enabled && !(ppu->status & PPU_STATUS_SPRITE_OVERFLOW)) {
+            ppu_evaluate_sprite_overflow(ppu);
+        }
+
+        int row = ppu_sprite_row(ppu, ppu->oam);
+
+        if (!background_enabled || !sprites_enabled || (ppu->status & PPU_STATUS_SPRITE_ZERO_HIT) || row < 0 ||
+            row >= ppu_sprite_height(ppu)) {
+            return;
+        }
+    }
+
+    uint8_t background[PPU_WIDTH + 8];
+    uint8_t sprites[PPU_WIDTH];
+    uint8_t colors[PPU_WIDTH];
+
+    if (background_enabled) {
+        ppu_render_background(ppu, background);
+    }
+
+    if (sprites_enabled) {
+        ppu_render_sprites(ppu, sprites);
+    }
+
+    uint8_t grayscale = ppu->mask & PPU_MASK_GRAYSCALE ? 0x30 : 0x3f;
+
+    for (int x = 0; x < PPU_WIDTH; x++) {
+        uint8_t background_pixel = 0;
+        uint8_t sprite_pixel = 0;
+
+        if (background_enabled && (x >= 8 || (ppu->mask & PPU_MASK_BACKGROUND_LEFT))) {
+            background_pixel = background[x + ppu->fine_x];
+        }
+
+        if (sprites_enabled && (x >= 8 || (ppu->mask & PPU_MASK_SPRITES_LEFT))) {
+            sprite_pixel = sprites[x];
+        }
+
+        if ((sprite_pixel & PPU_SPRITE_ZERO) && background_pixel != 0 && x != 255) {
+            ppu->status |= PPU_STATUS_SPRITE_ZERO_HIT;
+        }
+
+        uint8_t index = background_pixel;
+
+        if (sprite_pixel != 0 && (background_pixel == 0 || !(sprite_pixel & PPU_SPRITE_BEHIND))) {
+            index = sprite_pixel & 0x1f;
+        }
+
+        colors[x] = ppu->palette[index] & grayscale;
+    }
+
+    if (ppu->framebuffer != NULL) {
+        ppu_output_scanline(ppu, colors);
+    }
+}
+
+static void ppu_render_backdrop(Ppu *ppu) {
+    if (ppu->framebuffer == NULL) {
+        return;
+    }
+
+    uint8_t colors[PPU_WIDTH];
+
+    memset(colors, ppu->palette[0], PPU_WIDTH);
+
+    ppu_output_scanline(ppu, colors);
+}
+
+static uint16_t ppu_scanline_length(Ppu *ppu) {
+    // With rendering enabled the pre-render line of odd frames is one dot short
+    if (ppu->scanline == PPU_PRERENDER_SCANLINE && ppu->odd_frame && ppu_rendering(ppu)) {
+        return PPU_DOTS_PER_SCANLINE - 1;
+    }
+
+    return PPU_DOTS_PER_SCANLINE;
+}
+
+// The dot of a rendered line at which A12 goes high for the first time, going by which pattern table the sprite
+// fetches from dot 257 and the background fetches from dot 321 use. 0 when it stays low.
+static uint16_t ppu_a12_dot(Ppu *ppu) {
+    if (ppu->control & (PPU_CONTROL_SPRITE_TABLE | PPU_CONTROL_TALL_SPRITES)) {
+        return 260;
+    }
+
+    if (ppu->control & PPU_CONTROL_BACKGROUND_TABLE) {
+        return 324;
+    }
+
+    return 0;
+}
+
+// The dot at which this line clocks the scanline counter, 0 when it does not
+static uint16_t ppu_scanline_clock_dot(Ppu *ppu) {
+    if (!ppu->counts_scanlines || !ppu_rendering(ppu) ||
+        (ppu->scanline >= PPU_HEIGHT && ppu->scanline != PPU_PRERENDER_SCANLINE)) {
+        return 0;
+    }
+
+    return ppu_a12_dot(ppu);
+}
+
+// Dots where something observable happens, everything in between is covered by rendering whole scanlines
+static uint16_t ppu_next_event(Ppu *ppu) {
+    if (ppu->dot < 1) {
+        return 1;
+    }
+
+    if (ppu->dot < 257) {
+        return 257;
+    }
+
+    uint16_t event = ppu_scanline_length(ppu);
+
+    if (ppu->scanline == PPU_PRERENDER_SCANLINE && ppu->dot < 280) {
+        event = 280;
+    }
+
+    uint16_t clock_dot = ppu_scanline_clock_dot(ppu);
+
+    if (clock_dot > ppu->dot && clock_dot < event) {
+        event = clock_dot;
+    }
+
+    return event;
+}
+
+static void ppu_event(Ppu *ppu) {
+    if (ppu->dot == ppu_scanline_clock_dot(ppu)) {
+        ppu->scanline_clocks++;
+        return;
+    }
+
+    switch (ppu->dot) {
+    case 1:
+        if (ppu->scanline == PPU_VBLANK_SCANLINE) {
+            ppu->status |= PPU_STATUS_VBLANK;
+            ppu->frame++;
+
+            if (ppu->control & PPU_CONTROL_NMI) {
+                ppu->nmi = true;
+            }
+        } else if (ppu->scanline == PPU_PRERENDER_SCANLINE) {
+            ppu->status &= ~(PPU_STATUS_VBLANK | PPU_STATUS_SPRITE_ZERO_HIT | PPU_STATUS_SPRITE_OVERFLOW);
+        }
+        break;
+
+    case 257:
+        if (ppu->scanline < PPU_HEIGHT) {
+            if (ppu_rendering(ppu)) {
+                ppu_render_scanline(ppu);
+            } else {
+                ppu_render_backdrop(ppu);
+            }
+        }
+
+        if ((ppu->scanline < PPU_HEIGHT || ppu->scanline == PPU_PRERENDER_SCANLINE) && ppu_rendering(ppu)) {
+            ppu_increment_y(ppu);
+            ppu_copy_x(ppu);
+        }
+        break;
+
+    case 280:
+        if (ppu_rendering(ppu)) {
+            ppu_copy_y(ppu);
+        }
+        break;
+
+    default:
+        ppu->dot = 0;
+
+        if (++ppu->scanline == PPU_SCANLINES_PER_FRAME) {
+            ppu->scanline = 0;
+            ppu->odd_frame = !ppu->odd_frame;
+        }
+    }
+}
+
+void ppu_sync(Ppu *ppu, uint64_t master_clock) {
+    uint64_t target = master_clock * PPU_DOTS_PER_CYCLE;
+
+    while (clock_is_before(ppu->clock, target)) {
+        uint16_t event = ppu_next_event(ppu);
+
+        if (clock_is_before(target, ppu->clock + (event - ppu->dot))) {
+            ppu->dot += target - ppu->clock;
+            ppu->clock = target;
+            break;
+        }
+
+        ppu->clock += event - ppu->dot;
+        ppu->dot = event;
+
+        ppu_event(ppu);
+    }
+}
+
+uint64_t ppu_next_vblank(Ppu *ppu) {
+    uint32_t position = ppu->scanline * PPU_DOTS_PER_SCANLINE + ppu->dot;
+    uint32_t vblank = PPU_VBLANK_SCANLINE * PPU_DOTS_PER_SCANLINE + 1;
+    uint64_t dots;
+
+    if (position < vblank) {
+        dots = vblank - position;
+    } else {
+        dots = PPU_SCANLINES_PER_FRAME * PPU_DOTS_PER_SCANLINE - position + vblank;
+
+        // Unless rendering gets switched off in the meantime, which only makes this one dot early
+        if (ppu->odd_frame && ppu_rendering(ppu) &&
+            (ppu->scanline < PPU_PRERENDER_SCANLINE || ppu->dot < PPU_DOTS_PER_SCANLINE - 1)) {
+            dots--;
+        }
+    }
+
+    return (ppu->clock + dots + PPU_DOTS_PER_CYCLE - 1) / PPU_DOTS_PER_CYCLE;
+}
+
+bool ppu_next_scanline_clocks(Ppu *ppu, uint32_t count, uint64_t *master_clock) {
+    uint16_t clock_dot = ppu_a12_dot(ppu);
+
+    if (count == 0 || clock_dot == 0 || !ppu_rendering(ppu)) {
+        return false;
+    }
+
+    uint16_t scanline = ppu->scanline;
+    uint16_t dot = ppu->dot;
+    bool odd_frame = ppu->odd_frame;
+    uint64_t dots = 0;
+
+    // At most a frame and a bit, the counter never needs more than 256 clocks
+    while (true) {
+        if ((scanline < PPU_HEIGHT || scanline == PPU_PRERENDER_SCANLINE) && dot < clock_dot && --count == 0) {
+            dots += clock_dot - dot;
+            break;
+        }
+
+        uint16_t length = PPU_DOTS_PER_SCANLINE;
+
+        if (scanline == PPU_PRERENDER_SCANLINE && odd_frame) {
+            length--;
+        }
+
+        dots += length - dot;
+        dot = 0;
+
+        if (++scanline == PPU_SCANLINES_PER_FRAME) {
+            scanline = 0;
+            odd_frame = !odd_frame;
+        }
+    }
+
+    *master_clock = (ppu->clock + dots + PPU_DOTS_PER_CYCLE - 1) / PPU_DOTS_PER_CYCLE;
+
+    return true;
+}
+
+uint8_t ppu_read_register(Ppu *ppu, uint16_t pointer) {
+    switch (pointer & 7) {
+    case 2: {
+        uint8_t status = ppu->status | (ppu->latch & 0x1f);
+
+        ppu->status &= ~PPU_STATUS_VBLANK;
+        ppu->write_toggle = false;
+
+        return status;
+    }
+
+    case 4:
+        return ppu->oam[ppu->oam_address];
+
+    case 7: {
+        uint16_t address = ppu->v & 0x3fff;
+        uint8_t byte;
+
+        // Reads lag one byte behind through the buffer, except for the palette which answers straight away
+        // and fills the buffer with the nametable byte underneath it
+        if (address < 0x3f00) {
+            byte = ppu->read_buffer;
+            ppu->read_buffer = ppu_read(ppu, address);
+        } else {
+            byte = ppu_read(ppu, address) | (ppu->latch & 0xc0);
+            ppu->read_buffer = ppu_read(ppu, address & 0x2fff);
+        }
+
+        ppu_increment_address(ppu);
+
+        return byte;
+    }
+
+    default:
+        return ppu->latch;
+    }
+}
+
+void ppu_write_register(Ppu *ppu, uint16_t pointer, uint8_t byte) {
+    ppu->latch = byte;
+
+    switch (pointer & 7) {
+    case 0:
+        // Enabling NMIs during vertical blank raises one straight away
+        if (!(ppu->control & PPU_CONTROL_NMI) && (byte & PPU_CONTROL_NMI) && (ppu->status & PPU_STATUS_VBLANK)) {
+            ppu->nmi = true;
+        }
+
+        ppu->control = byte;
+        ppu->t = (ppu->t & ~0x0c00) | ((byte & 3) << 10);
+        break;
+
+    case 1:
+        ppu->mask = byte;
+        break;
+
+    case 3:
+        ppu->oam_address = byte;
+        break;
+
+    case 4:
+        ppu->oam[ppu->oam_address++] = byte;
+        break;
+
+    case 5:
+        if (!ppu->write_toggle) {
+            ppu->t = (ppu->t & ~0x001f) | (byte >> 3);
+            ppu->fine_x = byte & 7;
+        } else {
+            ppu->t = (ppu->t & ~0x73e0) | ((byte & 7) << 12) | ((byte & 0xf8) << 2);
+        }
+
+        ppu->write_toggle = !ppu->write_toggle;
+        break;
+
+    case 6:
+        if (!ppu->write_toggle) {
+            ppu->t = (ppu->t & 0x00ff) | ((byte & 0x3f) << 8);
+        } else {
+            ppu->t = (ppu->t & 0xff00) | byte;
+            ppu->v = ppu->t;
+        }
+
+        ppu->write_toggle = !ppu->write_toggle;
+        break;
+
+    case 7:
+        ppu_write(ppu, ppu->v, byte);
+        ppu_increment_address(ppu);
+        break;
+    }
+}
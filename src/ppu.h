@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mapper.h"
+#include "state.h"
+
+#define PPU_WIDTH 256
+#define PPU_HEIGHT 240
+
+// The PPU runs three dots for every CPU cycle
+#define PPU_DOTS_PER_CYCLE 3
+
+#define PPU_DOTS_PER_SCANLINE 341
+#define PPU_SCANLINES_PER_FRAME 262
+
+typedef enum {
+    // One byte per pixel holding the NES color index, 0 to 63
+    PPU_FORMAT_INDEXED,
+    // Four bytes per pixel in R, G, B, A order
+    PPU_FORMAT_RGBA,
+} PpuFormat;
+
+typedef struct {
+    uint8_t control;
+    uint8_t mask;
+    uint8_t status;
+    uint8_t oam_address;
+
+    // Loopy's scroll registers: the current VRAM address, the temporary one, fine X and the write toggle
+    uint16_t v;
+    uint16_t t;
+    uint8_t fine_x;
+    bool write_toggle;
+
+    uint8_t read_buffer;
+    // The last value written to any register, which is what reading a write-only register returns
+    uint8_t latch;
+
+    uint8_t oam[256];
+    uint8_t palette[32];
+    uint8_t nametables[4][0x400];
+
+    const uint8_t *chr_read[8];
+    uint8_t *chr_write[8];
+    uint8_t *chr_tiles[8];
+    uint8_t *nametable_pages[4];
+
+    // Position of the beam, clock counts dots since power on
+    uint64_t clock;
+    uint16_t scanline;
+    uint16_t dot;
+    bool odd_frame;
+
+    // Frames completed so far, bumped when vertical blank starts
+    uint64_t frame;
+
+    // Raised on the start of vertical blank when NMIs are enabled, the emulator clears it after delivering it
+    bool nmi;
+
+    // For mappers with a scanline counter: how often the pattern table address line A12 has gone high since
+    // power on, which happens once per rendered line
+    bool counts_scanlines;
+    uint64_t scanline_clocks;
+
+    // Owned by the caller, PPU_WIDTH * PPU_HEIGHT pixels, or NULL to skip drawing altogether
+    uint8_t *framebuffer;
+    PpuFormat format;
+} Ppu;
+
+void ppu_power_on(Ppu *);
+void ppu_map_mapper(Ppu *, Mapper *, MapperDesription *);
+void ppu_set_framebuffer(Ppu *, void *pixels, PpuFormat format);
+
+// Runs the PPU up to the given master clock, in CPU cycles
+void ppu_sync(Ppu *, uint64_t master_clock);
+
+// The master clock at which the next vertical blank starts, the deadline for the next frame and NMI
+uint64_t ppu_next_vblank(Ppu *);
+// The master clock by which scanline_clocks will have gone up by count, as long as rendering and the pattern
+// tables are left as they are. False when they do not clock it at all.
+bool ppu_next_scanline_clocks(Ppu *, uint32_t count, uint64_t *master_clock);
+
+uint8_t ppu_read_register(Ppu *, uint16_t pointer);
+void ppu_write_register(Ppu *, uint16_t pointer, uint8_t byte);
+
+// Registers, memories and the beam. Banks are not part of it, they come back with the mapper.
+void ppu_save_state(Ppu *, StateWriter *);
+void ppu_load_state(Ppu *, StateReader *);
@@ -0,0 +1,269 @@
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "emulator.h"
+#include "rewind.h"
+
+// Delta tokens: a control byte below 0x80 is followed by that many plus one literal bytes to XOR in, 0x80 is
+// followed by the length of a run of unchanged bytes as a LEB128 varint
+#define REWIND_LITERAL_MAX 128
+#define REWIND_ZERO_RUN 0x80
+
+// Shorter runs of unchanged bytes stay inside the literals around them, a token of their own would not pay
+#define REWIND_MIN_ZERO_RUN 4
+
+// Bytes of budget set aside for the bookkeeping of every delta
+#define REWIND_BUDGET_PER_ENTRY 64
+
+// Literals cost a control byte every 128 bytes, and cutting one short costs at most a zero run token
+static size_t rewind_worst_case(size_t state_size) { return state_size + state_size / 32 + 16; }
+
+// Length of the run of equal bytes at the start of a and b, compared a word at a time
+static size_t rewind_equal_run(const uint8_t *a, const uint8_t *b, size_t size) {
+    size_t i = 0;
+
+    while (i + 8 <= size) {
+        uint64_t lhs;
+        uint64_t rhs;
+
+        memcpy(&lhs, a + i, 8);
+        memcpy(&rhs, b + i, 8);
+
+        if (lhs != rhs) {
+            break;
+        }
+
+        i += 8;
+    }
+
+    while (i < size && a[i] == b[i]) {
+        i++;
+    }
+
+    return i;
+}
+
+// Encodes the XOR of two states, an unchanged tail is left out altogether
+static size_t rewind_encode(const uint8_t *older, const uint8_t *newer, size_t size, uint8_t *out) {
+    size_t length = 0;
+    size_t i = 0;
+
+    while (i < size) {
+        size_t zeros = rewind_equal_run(older + i, newer + i, size - i);
+
+        if (i + zeros == size) {
+            break;
+        }
+
+        if (zeros > 0) {
+            out[length++] = REWIND_ZERO_RUN;
+
+            for (size_t run = zeros; run > 0; run >>= 7) {
+                out[length++] = (run & 0x7f) | (run > 0x7f ? 0x80 : 0);
+            }
+
+            i += zeros;
+        }
+
+        // Extend the literal over short runs of unchanged bytes, up to the last changed byte
+        size_t start = i;
+        size_t end = i;
+
+        while (i < size && i - start < REWIND_LITERAL_MAX) {
+            if (older[i] != newer[i]) {
+                end = ++i;
+                continue;
+            }
+
+            size_t bound = size - i < REWIND_MIN_ZERO_RUN ? size - i : REWIND_MIN_ZERO_RUN;
+            size_t equal = rewind_equal_run(older + i, newer + i, bound);
+
+            if (equal == REWIND_MIN_ZERO_RUN || i + equal == size) {
+                break;
+            }
+
+            i += equal;
+        }
+
+        if (end - start > REWIND_LITERAL_MAX) {
+            end = start + REWIND_LITERAL_MAX;
+        }
+
+        out[length++] = end - start - 1;
+
+        for (size_t j = start; j < end; j++) {
+            out[length++] = older[j] ^ newer[j];
+        }
+
+        i = end;
+    }
+
+    return length;
+}
+
+static void rewind_apply(uint8_t *state, const uint8_t *delta, size_t size) {
+    size_t i = 0;
+    size_t position = 0;
+
+    while (position < size) {
+        uint8_t control = delta[position++];
+
+        if (control == REWIND_ZERO_RUN) {
+            size_t zeros = 0;
+            int shift = 0;
+            uint8_t byte;
+
+            do {
+                byte = delta[position++];
+                zeros |= (size_t)(byte & 0x7f) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+
+            i += zeros;
+        } else {
+            for (int j = 0; j <= control; j++) {
+                state[i++] ^= delta[position++];
+            }
+        }
+    }
+}
+
+static RewindEntry *rewind_entry(Rewind *rewind, int index) {
+    return &rewind->entries[(rewind->entries_first + index) % rewind->entries_capacity];
+}
+
+static void rewind_drop_oldest(Rewind *rewind) {
+    rewind->entries_first = (rewind->entries_first + 1) % rewind->entries_capacity;
+
+    if (--rewind->entries_count == 0) {
+        rewind->deltas_end = 0;
+    }
+}
+
+// Finds room for a delta of the given size, false when the oldest delta is in the way
+static bool rewind_place(Rewind *rewind, size_t size, size_t *offset) {
+    if (rewind->entries_count == 0) {
+        *offset = 0;
+        return true;
+    }
+
+    size_t start = rewind_entry(rewind, 0)->offset;
+    size_t end = rewind->deltas_end;
+
+    if (end > start) {
+        // Free space after the newest delta and before the oldest one, where the ring wraps around
+        if (end + size <= rewind->deltas_capacity) {
+            *offset = end;
+            return true;
+        }
+
+        if (size <= start) {
+            *offset = 0;
+            return true;
+        }
+
+        return false;
+    }
+
+    if (end + size <= start) {
+        *offset = end;
+        return true;
+    }
+
+    return false;
+}
+
+bool rewind_init(Rewind *rewind, Emulator *emulator, size_t budget) {
+    *rewind = (Rewind){0};
+
+    size_t state_size = emulator_state_size(emulator);
+    size_t worst_case = rewind_worst_case(state_size);
+    size_t fixed = 2 * state_size + worst_case;
+
+    if (budget < fixed + REWIND_BUDGET_PER_ENTRY) {
+        return false;
+    }
+
+    int entries_capacity = (budget - fixed) / REWIND_BUDGET_PER_ENTRY;
+    size_t entries_size = entries_capacity * sizeof(RewindEntry);
+
+    if (budget - fixed - entries_size < worst_case) {
+        return false;
+    }
+
+    uint8_t *memory = malloc(budget);
+
+    if (memory == NULL) {
+        return false;
+    }
+
+    // One allocation carved up, the entries go first to keep them aligned
+    rewind->entries = (RewindEntry *)memory;
+    rewind->entries_capacity = entries_capacity;
+    rewind->current = memory + entries_size;
+    rewind->scratch = rewind->current + state_size;
+    rewind->encoded = rewind->scratch + state_size;
+    rewind->deltas = rewind->encoded + worst_case;
+    rewind->deltas_capacity = budget - fixed - entries_size;
+    rewind->state_size = state_size;
+
+    return true;
+}
+
+void rewind_free(Rewind *rewind) {
+    free(rewind->entries);
+
+    *rewind = (Rewind){0};
+}
+
+void rewind_push(Rewind *rewind, Emulator *emulator) {
+    if (emulator_save_state(emulator, rewind->scratch, rewind->state_size) == 0) {
+        return;
+    }
+
+    if (rewind->has_current) {
+        size_t size = rewind_encode(rewind->current, rewind->scratch, rewind->state_size, rewind->encoded);
+        size_t offset;
+
+        if (rewind->entries_count == rewind->entries_capacity) {
+            rewind_drop_oldest(rewind);
+        }
+
+        while (!rewind_place(rewind, size, &offset)) {
+            rewind_drop_oldest(rewind);
+        }
+
+        memcpy(rewind->deltas + offset, rewind->encoded, size);
+
+        *rewind_entry(rewind, rewind->entries_count++) = (RewindEntry){.offset = offset, .size = size};
+        rewind->deltas_end = offset + size;
+    }
+
+    uint8_t *newest = rewind->scratch;
+
+    rewind->scratch = rewind->current;
+    rewind->current = newest;
+    rewind->has_current = true;
+}
+
+bool rewind_step_back(Rewind *rewind, Emulator *emulator) {
+    if (rewind->entries_count == 0) {
+        return false;
+    }
+
+    RewindEntry *newest = rewind_entry(rewind, rewind->entries_count - 1);
+
+    rewind_apply(rewind->current, rewind->deltas + newest->offset, newest->size);
+
+    rewind->deltas_end = newest->offset;
+
+    if (--rewind->entries_count == 0) {
+        rewind->deltas_end = 0;
+    }
+
+    return emulator_load_state(emulator, rewind->current, rewind->state_size);
+}
+
+int rewind_frames(Rewind *rewind) { return rewind->entries_count; }
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emulator.h"
+
+typedef struct {
+    size_t offset;
+    size_t size;
+} RewindEntry;
+
+// History of save states within a fixed memory budget. Only the newest state is kept whole, every older one
+// is the XOR of itself and its successor, run-length encoded. Frames rarely change more than a few hundred
+// bytes, so a delta is a few runs of zeros and a handful of literals. When the budget runs out the oldest
+// deltas are dropped.
+typedef struct {
+    size_t state_size;
+    uint8_t *current;
+    uint8_t *scratch;
+    uint8_t *encoded;
+    bool has_current;
+
+    // Deltas back from each state to the one before, oldest first, in a ring of bytes that ends where the
+    // newest delta ends
+    uint8_t *deltas;
+    size_t deltas_capacity;
+    size_t deltas_end;
+
+    RewindEntry *entries;
+    int entries_capacity;
+    int entries_first;
+    int entries_count;
+} Rewind;
+
+// Sizes the history for the ROM the emulator is running, every byte it allocates counts against budget.
+// Returns false when the budget does not even hold the newest state and one delta of the worst case. It has
+// to be set up again after loading another ROM.
+bool rewind_init(Rewind *, Emulator *, size_t budget);
+void rewind_free(Rewind *);
+
+// Records the state the emulator is in, usually once per frame
+void rewind_push(Rewind *, Emulator *);
+// Loads the state before the newest one and forgets the newest, false when there is nothing to go back to
+bool rewind_step_back(Rewind *, Emulator *);
+// How many frames rewind_step_back can go back
+int rewind_frames(Rewind *);
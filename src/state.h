@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Save states are flat little endian streams every component appends its fields to, in a fixed order.
+// Writing keeps counting past the end of the buffer, so a writer without one measures how big a state is.
+typedef struct {
+    uint8_t *data;
+    size_t capacity;
+    size_t size;
+} StateWriter;
+
+// Reading past the end yields zeros and marks the reader failed, which is checked once at the end
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+    bool failed;
+} StateReader;
+
+static inline void state_write_bytes(StateWriter *writer, const void *bytes, size_t count) {
+    if (writer->size + count <= writer->capacity) {
+        memcpy(writer->data + writer->size, bytes, count);
+    }
+
+    writer->size += count;
+}
+
+static inline void state_write_u64(StateWriter *writer, uint64_t value) {
+    uint8_t bytes[8];
+
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = value >> (i * 8);
+    }
+
+    state_write_bytes(writer, bytes, 8);
+}
+
+static inline void state_write_u32(StateWriter *writer, uint32_t value) {
+    uint8_t bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+
+    state_write_bytes(writer, bytes, 4);
+}
+
+static inline void state_write_u16(StateWriter *writer, uint16_t value) {
+    uint8_t bytes[2] = {value, value >> 8};
+
+    state_write_bytes(writer, bytes, 2);
+}
+
+static inline void state_write_u8(StateWriter *writer, uint8_t value) { state_write_bytes(writer, &value, 1); }
+
+static inline bool state_read_bytes(StateReader *reader, void *bytes, size_t count) {
+    if (reader->failed || count > reader->size - reader->offset) {
+        reader->failed = true;
+        memset(bytes, 0, count);
+
+        return false;
+    }
+
+    memcpy(bytes, reader->data + reader->offset, count);
+    reader->offset += count;
+
+    return true;
+}
+
+static inline uint64_t state_read_u64(StateReader *reader) {
+    uint8_t bytes[8];
+    uint64_t value = 0;
+
+    state_read_bytes(reader, bytes, 8);
+
+    for (int i = 0; i < 8; i++) {
+        value |= (uint64_t)bytes[i] << (i * 8);
+    }
+
+    return value;
+}
+
+static inline uint32_t state_read_u32(StateReader *reader) {
+    uint8_t bytes[4];
+
+    state_read_bytes(reader, bytes, 4);
+
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static inline uint16_t state_read_u16(StateReader *reader) {
+    uint8_t bytes[2];
+
+    state_read_bytes(reader, bytes, 2);
+
+    return bytes[0] | bytes[1] << 8;
+}
+
+static inline uint8_t state_read_u8(StateReader *reader) {
+    uint8_t value;
+
+    state_read_bytes(reader, &value, 1);
+
+    return value;
+}
@@ -0,0 +1,107 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tile.h"
+
+#ifdef TILE_X86
+#include <immintrin.h>
+#endif
+
+void tile_decode_rows_scalar(const uint8_t *low, const uint8_t *high, const uint8_t *palette, int count,
+                             uint8_t *pixels) {
+    for (int tile = 0; tile < count; tile++) {
+        for (int i = 0; i < 8; i++) {
+            uint8_t color = ((low[tile] >> (7 - i)) & 1) | (((high[tile] >> (7 - i)) & 1) << 1);
+
+            pixels[tile * 8 + i] = color != 0 ? palette[tile] | color : 0;
+        }
+    }
+}
+
+#ifdef TILE_X86
+// Repeats a byte across the 8 bytes of a word, one for every pixel of the row
+static inline long long tile_broadcast(uint8_t byte) { return byte * 0x0101010101010101ULL; }
+
+// Leftmost pixel first, so byte i of a row tests bit 7 - i
+#define TILE_PIXEL_BITS 0x0102040810204080LL
+
+void tile_decode_rows_sse2(const uint8_t *low, const uint8_t *high, const uint8_t *palette, int count,
+                           uint8_t *pixels) {
+    const __m128i bits = _mm_set1_epi64x(TILE_PIXEL_BITS);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i two = _mm_set1_epi8(2);
+
+    int tile = 0;
+
+    for (; tile + 2 <= count; tile += 2) {
+        __m128i low_bits = _mm_set_epi64x(tile_broadcast(low[tile + 1]), tile_broadcast(low[tile]));
+        __m128i high_bits = _mm_set_epi64x(tile_broadcast(high[tile + 1]), tile_broadcast(high[tile]));
+        __m128i palettes = _mm_set_epi64x(tile_broadcast(palette[tile + 1]), tile_broadcast(palette[tile]));
+
+        // 0xff in every pixel whose bit is set in the plane
+        __m128i low_set = _mm_cmpeq_epi8(_mm_and_si128(low_bits, bits), bits);
+        __m128i high_set = _mm_cmpeq_epi8(_mm_and_si128(high_bits, bits), bits);
+
+        __m128i color = _mm_or_si128(_mm_and_si128(low_set, one), _mm_and_si128(high_set, two));
+        __m128i opaque = _mm_or_si128(low_set, high_set);
+
+        _mm_storeu_si128((__m128i *)(pixels + tile * 8), _mm_or_si128(color, _mm_and_si128(palettes, opaque)));
+    }
+
+    tile_decode_rows_scalar(low + tile, high + tile, palette + tile, count - tile, pixels + tile * 8);
+}
+
+__attribute__((target("avx2"))) void tile_decode_rows_avx2(const uint8_t *low, const uint8_t *high,
+                                                            const uint8_t *palette, int count, uint8_t *pixels) {
+    const __m256i bits = _mm256_set1_epi64x(TILE_PIXEL_BITS);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi8(2);
+
+    int tile = 0;
+
+    for (; tile + 4 <= count; tile += 4) {
+        __m256i low_bits = _mm256_set_epi64x(tile_broadcast(low[tile + 3]), tile_broadcast(low[tile + 2]),
+                                             tile_broadcast(low[tile + 1]), tile_broadcast(low[tile]));
+        __m256i high_bits = _mm256_set_epi64x(tile_broadcast(high[tile + 3]), tile_broadcast(high[tile + 2]),
+                                              tile_broadcast(high[tile + 1]), tile_broadcast(high[tile]));
+        __m256i palettes =
+            _mm256_set_epi64x(tile_broadcast(palette[tile + 3]), tile_broadcast(palette[tile + 2]),
+                              tile_broadcast(palette[tile + 1]), tile_broadcast(palette[tile]));
+
+        __m256i low_set = _mm256_cmpeq_epi8(_mm256_and_si256(low_bits, bits), bits);
+        __m256i high_set = _mm256_cmpeq_epi8(_mm256_and_si256(high_bits, bits), bits);
+
+        __m256i color = _mm256_or_si256(_mm256_and_si256(low_set, one), _mm256_and_si256(high_set, two));
+        __m256i opaque = _mm256_or_si256(low_set, high_set);
+
+        _mm256_storeu_si256((__m256i *)(pixels + tile * 8),
+                            _mm256_or_si256(color, _mm256_and_si256(palettes, opaque)));
+    }
+
+    tile_decode_rows_sse2(low + tile, high + tile, palette + tile, count - tile, pixels + tile * 8);
+}
+
+bool tile_avx2_supported(void) { return __builtin_cpu_supports("avx2"); }
+#endif
+
+void tile_decode_rows(const uint8_t *low, const uint8_t *high, const uint8_t *palette, int count,
+                      uint8_t *pixels) {
+#ifdef TILE_X86
+    if (tile_avx2_supported()) {
+        tile_decode_rows_avx2(low, high, palette, count, pixels);
+    } else {
+        tile_decode_rows_sse2(low, high, palette, count, pixels);
+    }
+#else
+    tile_decode_rows_scalar(low, high, palette, count, pixels);
+#endif
+}
+
+void tile_decode_chr(const uint8_t *chr, uint32_t size, uint8_t *tiles) {
+    // The 8 rows of a tile are consecutive bytes in both planes, so a tile decodes like 8 rows of a line
+    static const uint8_t no_palettes[8] = {0};
+
+    for (uint32_t tile = 0; tile < size / 16; tile++) {
+        tile_decode_rows(chr + tile * 16, chr + tile * 16 + 8, no_palettes, 8, tiles + tile * 64);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Decodes rows of 2bpp planar tiles into one byte per pixel. Every row comes from its low and high bitplane
+// bytes and the attribute palette (already shifted into bits 2 and 3), and becomes 8 pixels holding
+// palette | color, or 0 where the color is transparent.
+//
+// They build the CHR tile cache the renderer reads, the renderer itself decodes nothing. tile_decode_chr runs
+// them over whole pattern tables at load, and the PPU over the single row a CHR RAM write touched, which is
+// too short for the SIMD paths and ends up in their scalar tail. Both pass a palette of 0.
+typedef void (*TileRowDecoder)(const uint8_t *low, const uint8_t *high, const uint8_t *palette, int count,
+                               uint8_t *pixels);
+
+// Picks the widest implementation the host supports
+void tile_decode_rows(const uint8_t *low, const uint8_t *high, const uint8_t *palette, int count,
+                      uint8_t *pixels);
+
+void tile_decode_rows_scalar(const uint8_t *low, const uint8_t *high, const uint8_t *palette, int count,
+                             uint8_t *pixels);
+
+// Decodes whole pattern tables, every 16 bytes of bitplanes become the 64 pixels of an 8x8 tile, row by row,
+// each holding its color from 0 to 3
+void tile_decode_chr(const uint8_t *chr, uint32_t size, uint8_t *tiles);
+
+#ifdef __SSE2__
+#define TILE_X86 1
+
+// 2 tile rows, 16 pixels, at a time
+void tile_decode_rows_sse2(const uint8_t *low, const uint8_t *high, const uint8_t *palette, int count,
+                           uint8_t *pixels);
+
+// 4 tile rows, 32 pixels, at a time, only callable when tile_avx2_supported says so
+void tile_decode_rows_avx2(const uint8_t *low, const uint8_t *high, const uint8_t *palette, int count,
+                           uint8_t *pixels);
+
+bool tile_avx2_supported(void);
+#endif